@@ -0,0 +1,428 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Standard
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+
+// OpenCV 3.1.0
+#include <opencv2/opencv.hpp>
+
+// Radial Stitcher
+#include "BatchStitcher.hpp"
+#include "ImageReader.hpp"
+#include "ParallelFor.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+const size_t BatchStitcher::queueDepth;
+const size_t BatchStitcher::prefetchDepth;
+const int BatchStitcher::numWriters;
+
+
+// True for the still formats OpenCV decodes
+// -----------------------------------------------------------------------------
+static bool isImage(const std::string& fileName){
+
+    size_t dot = fileName.find_last_of('.');
+    if(dot == std::string::npos) return false;
+
+    std::string ext = fileName.substr(dot + 1);
+    for (size_t c = 0; c < ext.size(); c++) ext[c] = (char) tolower(ext[c]);
+
+    return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "tif" ||
+        ext == "tiff" || ext == "bmp";
+
+}
+
+
+// Shorter names first so 2.jpg comes before 10.jpg
+// -----------------------------------------------------------------------------
+static bool numericOrder(const std::string& a, const std::string& b){
+
+    if(a.size() != b.size()) return a.size() < b.size();
+    return a < b;
+
+}
+
+
+// Set directory as a file name, a/b/../c becomes a_b_c
+// -----------------------------------------------------------------------------
+static std::string setName(const std::string& dir){
+
+    std::string name;
+    std::stringstream parts(dir);
+    std::string part;
+    while (std::getline(parts, part, '/')) {
+        if(part.empty() || part == "." || part == "..") continue;
+        if(!name.empty()) name += "_";
+        name += part;
+    }
+
+    return name.empty() ? "panorama" : name;
+
+}
+
+
+// Initialize batch parameters, sets are found when the batch runs
+BatchStitcher::BatchStitcher(const char * inputName, const char * outputDir,
+    const RadialStitcher::Settings& settings)
+    : decodeQueue(prefetchDepth), recycleQueue(prefetchDepth + 2), writeQueue(queueDepth), failures(0) {
+
+    this->inputName = inputName;
+    this->outputDir = outputDir;
+    this->settings = settings;
+
+}
+
+
+BatchStitcher::~BatchStitcher(){}
+
+
+// Transforms saved by --calibrate, loaded into every stitcher before its set
+// -----------------------------------------------------------------------------
+int BatchStitcher::setCalibration(const std::string& fileName){
+
+    calibName = fileName;
+    return 0;
+
+}
+
+
+// Adds the images directly in dir as one set, in numeric order
+// -----------------------------------------------------------------------------
+int BatchStitcher::addDirectory(const std::string& dir, const std::string& output){
+
+    std::vector<cv::String> found;
+    cv::glob(dir + "/*", found, false);
+
+    Set set;
+    set.output = output;
+    for (size_t f = 0; f < found.size(); f++) {
+        if(isImage(found[f])) set.images.push_back(found[f]);
+    }
+    std::sort(set.images.begin(), set.images.end(), numericOrder);
+
+    if(set.images.size() < 2){
+        std::cout << "Set " << dir << " has fewer than 2 images, skipped." << std::endl;
+        return -1;
+    }
+
+    sets.push_back(set);
+    return 0;
+
+}
+
+
+// Parses the manifest, paths inside it are relative to the manifest itself
+// -----------------------------------------------------------------------------
+int BatchStitcher::readManifest(){
+
+    std::ifstream manifest(inputName.c_str());
+    if(!manifest.is_open()){
+        std::cout << "Manifest " << inputName << " could not be read." << std::endl;
+        return -1;
+    }
+
+    size_t slash = inputName.find_last_of('/');
+    std::string base = (slash == std::string::npos) ? "" : inputName.substr(0, slash + 1);
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(manifest, line)) {
+
+        lineNumber++;
+        size_t hash = line.find('#');
+        if(hash != std::string::npos) line.erase(hash);
+
+        std::vector<std::string> tokens;
+        std::stringstream words(line);
+        std::string word;
+        while (words >> word) tokens.push_back(word);
+        if(tokens.empty()) continue;
+
+        std::string name = setName(tokens[0]);
+        for (size_t t = 0; t < tokens.size(); t++) {
+            if(tokens[t][0] != '/') tokens[t] = base + tokens[t];
+        }
+
+        // A lone path is a set directory
+        if(tokens.size() == 1){
+            addDirectory(tokens[0], name + ".jpg");
+            continue;
+        }
+
+        if(tokens.size() < 3){
+            std::cout << "Manifest line " << lineNumber << " needs an output and at least 2 images." << std::endl;
+            continue;
+        }
+
+        Set set;
+        set.output = name;
+        set.images.assign(tokens.begin() + 1, tokens.end());
+        sets.push_back(set);
+
+    }
+
+    return 0;
+
+}
+
+
+// Every directory under dir that holds images becomes a set, named by its path
+// below dir
+// -----------------------------------------------------------------------------
+int BatchStitcher::scanDirectory(const std::string& dir){
+
+    std::vector<cv::String> found;
+    cv::glob(dir + "/*", found, true);
+
+    std::map<std::string, int> parents; // Sorted, so sets come in path order
+    for (size_t f = 0; f < found.size(); f++) {
+        if(!isImage(found[f])) continue;
+        size_t slash = found[f].find_last_of('/');
+        parents[found[f].substr(0, slash)]++;
+    }
+
+    for (std::map<std::string, int>::iterator it = parents.begin(); it != parents.end(); ++it) {
+        std::string below = it->first.size() > dir.size() ? it->first.substr(dir.size()) : "";
+        addDirectory(it->first, setName(below.empty() ? dir : below) + ".jpg");
+    }
+
+    return 0;
+
+}
+
+
+// Idle stitcher for this camera count, reset for a new set, or a new one
+// -----------------------------------------------------------------------------
+cv::Ptr<RadialStitcher> BatchStitcher::acquire(int numImages){
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    for (size_t p = 0; p < pool.size(); p++) {
+        if(pool[p]->getNumImages() != numImages) continue;
+        cv::Ptr<RadialStitcher> stitcher = pool[p];
+        pool.erase(pool.begin() + p);
+        stitcher->reset();
+        return stitcher;
+    }
+
+    cv::Ptr<RadialStitcher> stitcher = cv::makePtr<RadialStitcher>(numImages, settings);
+    if(warpCache.empty()) warpCache = stitcher->getWarpCache();
+    else stitcher->setWarpCache(warpCache);
+
+    return stitcher;
+
+}
+
+
+void BatchStitcher::release(const cv::Ptr<RadialStitcher>& stitcher){
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    pool.push_back(stitcher);
+
+}
+
+
+// Decode thread, reads sets in manifest order into recycled buffers so the
+// next sets are ready when a stitcher frees up
+// -----------------------------------------------------------------------------
+void BatchStitcher::decode(){
+
+    ImageReader reader(settings.decodeScale);
+
+    for (int s = 0; s < (int) sets.size(); s++) {
+
+        Decoded decoded;
+        decoded.set = s;
+        recycleQueue.tryPop(decoded.images);
+        decoded.status = reader.read(sets[s].images, decoded.images);
+
+        if(!decodeQueue.push(decoded)) break;
+
+    }
+
+    decodeQueue.close();
+
+}
+
+
+// Stitches the next decoded set and queues its panorama for writing
+// -----------------------------------------------------------------------------
+int BatchStitcher::stitchSet(){
+
+    Decoded decoded;
+    if(!decodeQueue.pop(decoded)) return -1;
+
+    const Set& set = sets[decoded.set];
+    cv::Ptr<RadialStitcher> stitcher = acquire((int) set.images.size());
+
+    int status = decoded.status;
+    if(!status && !calibName.empty()) status = stitcher->loadCalibration(calibName);
+    if(!status) status = stitcher->setImages(decoded.images);
+
+    Output output; // Own buffer, it outlives the stitcher's next set
+    output.fileName = outputDir + "/" + set.output;
+    if(!status) status = stitcher->Stitch(output.panorama);
+
+    release(stitcher);
+    recycleQueue.tryPush(decoded.images); // Idle stitchers never touch their old frames
+
+    if(status){
+        std::cout << "Set " << set.output << " failed." << std::endl;
+        failures++;
+        return -1;
+    }
+
+    if(!writeQueue.push(output)) return -1;
+    return 0;
+
+}
+
+
+// Writer thread, encodes panoramas while the next sets stitch
+// -----------------------------------------------------------------------------
+void BatchStitcher::write(){
+
+    Output output;
+    while (writeQueue.pop(output)) {
+
+        bool written = false;
+        try {
+            written = cv::imwrite(output.fileName, output.panorama);
+        } catch (const cv::Exception&) {
+            written = false;
+        }
+
+        if(written){
+            std::cout << "Wrote " << output.fileName << std::endl;
+        } else {
+            std::cout << "Panorama " << output.fileName << " could not be written." << std::endl;
+            failures++;
+        }
+
+        output.panorama.release();
+
+    }
+
+}
+
+
+// Finds the sets and stitches them all, sets run in parallel with each other
+// and with the stitcher's own loops on one pool
+// -----------------------------------------------------------------------------
+int BatchStitcher::Run(){
+
+    struct stat info;
+    if(stat(inputName.c_str(), &info)){
+        std::cout << "Batch " << inputName << " could not be found." << std::endl;
+        return -1;
+    }
+
+    int status = S_ISDIR(info.st_mode) ? scanDirectory(inputName) : readManifest();
+    if(status) return -1;
+
+    if(sets.empty()){
+        std::cout << "No image sets found in " << inputName << "." << std::endl;
+        return -1;
+    }
+
+    mkdir(outputDir.c_str(), 0755); // Fine if it already exists
+    if(settings.numThreads > 0) cv::setNumThreads(settings.numThreads);
+
+    std::cout << "Stitching " << sets.size() << " sets..." << std::endl;
+    int64 start = cv::getTickCount();
+
+    std::thread decoder(&BatchStitcher::decode, this);
+    std::vector<std::thread> writers;
+    for (int w = 0; w < numWriters; w++) writers.push_back(std::thread(&BatchStitcher::write, this));
+
+    // Nested loops run serially on some backends, so with fewer sets than
+    // threads each set gets the pool to itself instead. Either way every
+    // task takes whichever set was decoded next
+    int numSets = (int) sets.size();
+    if(numSets < cv::getNumThreads()){
+        for (int s = 0; s < numSets; s++) stitchSet();
+    } else {
+        parallelFor(numSets, [this](int){ stitchSet(); });
+    }
+
+    decoder.join();
+    writeQueue.close();
+    for (int w = 0; w < numWriters; w++) writers[w].join();
+
+    double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+    std::cout << "Stitched " << numSets - failures << " of " << numSets << " sets in "
+        << seconds << " s." << std::endl;
+
+    return failures ? -1 : 0;
+
+}
@@ -0,0 +1,154 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BATCH_STITCHER_HPP
+#define BATCH_STITCHER_HPP
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameQueue.hpp"
+#include "RadialStitcher.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Batch Stitcher Class stitches many unrelated image sets, listed in a manifest
+// or found under a directory, each to its own panorama. Sets are scheduled on
+// the same cv::parallel_for_ pool the stitcher splits its own work on, so a
+// batch of small sets and a few big ones both keep the cores busy. Stitchers
+// are pooled by camera count and share one warp map cache, so sets shot with
+// the same rig only build their maps once. Panoramas are encoded and written
+// by their own threads while the next sets stitch.
+// -----------------------------------------------------------------------------
+class BatchStitcher {
+
+    public:
+
+        // Manifest lines are either a set directory, or an output name followed
+        // by its images. Blank lines and # comments are skipped. A directory
+        // instead of a manifest makes every directory of images under it a set
+        BatchStitcher(const char * inputName, const char * outputDir,
+            const RadialStitcher::Settings& settings = RadialStitcher::Settings());
+        ~BatchStitcher();
+
+        int setCalibration(const std::string& fileName); // Every set uses these transforms
+        int Run(); // Stitch every set, nonzero if any failed
+
+    private:
+
+        struct Set {
+            std::string output; // Panorama file name
+            std::vector<std::string> images; // Left to right
+        };
+
+        struct Decoded {
+            int set;
+            std::vector<cv::Mat> images;
+            int status;
+        };
+
+        struct Output {
+            std::string fileName;
+            cv::Mat panorama;
+        };
+
+        // Batch Parameters
+        static const size_t queueDepth = 4; // Panoramas waiting to be written
+        static const size_t prefetchDepth = 2; // Sets decoded ahead of the stitchers
+        static const int numWriters = 2;
+
+        std::string inputName;
+        std::string outputDir;
+        std::string calibName;
+        RadialStitcher::Settings settings;
+
+        std::vector<Set> sets;
+
+        // Idle stitchers, reset and reused by the next set with the same count
+        std::mutex poolMutex;
+        std::vector<cv::Ptr<RadialStitcher> > pool;
+        cv::Ptr<RadialStitcher::WarpCache> warpCache; // Shared by the pool, least recently used maps evicted
+
+        FrameQueue<Decoded> decodeQueue;
+        FrameQueue<std::vector<cv::Mat> > recycleQueue; // Decode buffers handed back for reuse
+        FrameQueue<Output> writeQueue;
+        std::atomic<int> failures;
+
+        // Auxiliary functions
+        int readManifest();
+        int scanDirectory(const std::string& dir);
+        int addDirectory(const std::string& dir, const std::string& output);
+        cv::Ptr<RadialStitcher> acquire(int numImages);
+        void release(const cv::Ptr<RadialStitcher>& stitcher);
+        void decode();
+        int stitchSet();
+        void write();
+
+};
+
+#endif
@@ -0,0 +1,493 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Standard
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+// OpenCV 3.1.0
+#include <opencv2/opencv.hpp>
+
+// Radial Stitcher
+#include "RadialStitcher.hpp"
+#ifdef RADSTITCH_WITH_CUDA
+#include "GpuStitcher.hpp"
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// How to use this program
+// -----------------------------------------------------------------------------
+int usage(){
+    std::cout << std::endl;
+    std::cout << "Usage:" << std::endl;
+    std::cout << "    ./radStitchBench [options] [<set dir>[:<focal>] ...]" << std::endl;
+    std::cout << std::endl;
+    std::cout << "    Stitches every set (0.jpg, 1.jpg, ... in each directory, default ../img/pano/la" << std::endl;
+    std::cout << "    and ../img/pano/sf) with every mode, reports stage times, throughput, peak RSS" << std::endl;
+    std::cout << "    and PSNR. Exits nonzero if any stitch fails or falls below --min-psnr" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "    --iterations <N>         Composes timed per run (default 5)" << std::endl;
+    std::cout << "    --focal <pixels>         Focal length of sets without their own (default 2800)" << std::endl;
+    std::cout << "    --variants <list>        Comma separated native, 4k, 8k (default native,4k)" << std::endl;
+    std::cout << "    --references <dir>       Compare each run to <dir>/<set>_<variant>_<mode>.png, recording missing ones" << std::endl;
+    std::cout << "    --min-psnr <dB>          Regression threshold against references (default 40)" << std::endl;
+    std::cout << "    --json <file.jsonl>      Also write one JSON line per run" << std::endl;
+    std::cout << std::endl;
+    exit(1);
+};
+
+
+// Stitch set, decoded once and reused by every run
+struct Set {
+    std::string name; // Directory name e.g. la
+    std::vector<cv::Mat> images;
+    double focalLength;
+};
+
+
+// One benchmarked configuration
+struct Mode {
+    std::string name;
+    RadialStitcher::Settings settings;
+    bool gpu; // Registered on the CPU, composed by the CUDA backend
+};
+
+
+struct Result {
+    double prewarpMs;
+    double registerMs;
+    double composeMs; // Per frame, after a warm up
+    double peakMb; // Resident set high water mark during the run
+    double psnr; // dB against the reference, < 0 when there is none
+    cv::Size canvas;
+};
+
+
+// Reads 0.jpg, 1.jpg, ... until one is missing
+// -----------------------------------------------------------------------------
+static int loadSet(const std::string& spec, double focalLength, Set& set){
+
+    std::string dir = spec;
+    set.focalLength = focalLength;
+
+    size_t colon = spec.rfind(':');
+    if(colon != std::string::npos){
+        dir = spec.substr(0, colon);
+        set.focalLength = atof(spec.c_str() + colon + 1);
+    }
+
+    while (!dir.empty() && dir[dir.size() - 1] == '/') dir.erase(dir.size() - 1);
+    size_t slash = dir.rfind('/');
+    set.name = slash == std::string::npos ? dir : dir.substr(slash + 1);
+
+    set.images.clear();
+    for (int i = 0; ; i++) {
+        std::ostringstream file;
+        file << dir << "/" << i << ".jpg";
+        cv::Mat image = cv::imread(file.str(), 1);
+        if(!image.data) break;
+        set.images.push_back(image);
+    }
+
+    if(set.images.size() < 2){
+        std::cout << "Set " << dir << " has fewer than 2 images." << std::endl;
+        return -1;
+    }
+
+    return 0;
+
+}
+
+
+// Synthetic high resolution copy of a set, frames upscaled to width pixels
+// wide. Focal length scales along so the geometry is unchanged
+// -----------------------------------------------------------------------------
+static void upscaleSet(const Set& set, int width, Set& out){
+
+    double factor = (double) width / set.images[0].cols;
+
+    out.name = set.name;
+    out.focalLength = set.focalLength * factor;
+    out.images.resize(set.images.size());
+
+    for (size_t i = 0; i < set.images.size(); i++) {
+        cv::resize(set.images[i], out.images[i], cv::Size(), factor, factor, cv::INTER_CUBIC);
+    }
+
+}
+
+
+// Peak resident set since the last reset, in MB. Linux can reset the high
+// water mark, elsewhere it is the peak of the whole process
+// -----------------------------------------------------------------------------
+static void resetPeakRss(){
+
+#ifdef __linux__
+    std::ofstream refs("/proc/self/clear_refs");
+    if(refs.is_open()) refs << "5";
+#endif
+
+}
+
+
+static double peakRssMb(){
+
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if(line.compare(0, 6, "VmHWM:") == 0) return atof(line.c_str() + 6) / 1024.0; // kB
+    }
+
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0) return usage.ru_maxrss / 1024.0;
+#endif
+
+    return -1;
+
+}
+
+
+static double msSince(int64 start){
+
+    return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+}
+
+
+// Prewarps, registers and composes a set with one mode
+// -----------------------------------------------------------------------------
+static int runMode(Set& set, const Mode& mode, int iterations, Result& result, cv::Mat& panorama){
+
+    resetPeakRss();
+
+    RadialStitcher::Settings settings = mode.settings;
+    settings.focalLength = set.focalLength;
+    if(settings.numThreads > 0) cv::setNumThreads(settings.numThreads); // Stitchers leave the pool alone
+    RadialStitcher rs((int) set.images.size(), settings);
+
+    int64 start = cv::getTickCount();
+    if(rs.setImages(set.images) || rs.prewarp()) return -1;
+    result.prewarpMs = msSince(start);
+
+    start = cv::getTickCount();
+    if(rs.estimateTransforms()) return -1;
+    result.registerMs = msSince(start);
+
+    if(rs.compose(panorama)) return -1; // Warm up sizes every buffer
+
+#ifdef RADSTITCH_WITH_CUDA
+    if(mode.gpu){
+        GpuStitcher gpu;
+        if(gpu.init(rs) || gpu.stitch(set.images, panorama)) return -1;
+
+        start = cv::getTickCount();
+        for (int i = 0; i < iterations; i++) {
+            if(gpu.stitch(set.images, panorama)) return -1;
+        }
+        result.composeMs = msSince(start) / iterations;
+
+        result.peakMb = peakRssMb();
+        result.canvas = panorama.size();
+
+        return 0;
+    }
+#endif
+
+    start = cv::getTickCount();
+    for (int i = 0; i < iterations; i++) {
+        if(rs.compose(panorama)) return -1;
+    }
+    result.composeMs = msSince(start) / iterations;
+
+    result.peakMb = peakRssMb();
+    result.canvas = panorama.size();
+
+    return 0;
+
+}
+
+
+// PSNR of panorama against reference, -1 if they can't be compared
+// -----------------------------------------------------------------------------
+static double comparePanoramas(const cv::Mat& panorama, const cv::Mat& reference){
+
+    if(!reference.data || reference.size() != panorama.size() || reference.type() != panorama.type()) return -1;
+
+    return cv::PSNR(panorama, reference); // 361 dB cap for identical images
+
+}
+
+
+// Every alternative against the default pipeline, then a thread sweep
+// -----------------------------------------------------------------------------
+static std::vector<Mode> benchmarkModes(){
+
+    std::vector<Mode> modes;
+    RadialStitcher::Settings base;
+
+    Mode mode;
+    mode.gpu = false;
+    mode.name = "default";
+    mode.settings = base;
+    modes.push_back(mode);
+
+    mode.name = "ransac";
+    mode.settings = base;
+    mode.settings.estimator = RadialStitcher::RANSAC;
+    modes.push_back(mode);
+
+    mode.name = "multiband";
+    mode.settings = base;
+    mode.settings.blendMode = RadialStitcher::MULTIBAND;
+    modes.push_back(mode);
+
+    mode.name = "seam";
+    mode.settings = base;
+    mode.settings.blendMode = RadialStitcher::SEAM;
+    modes.push_back(mode);
+
+    mode.name = "per-pixel";
+    mode.settings = base;
+    mode.settings.useWarpMaps = false;
+    modes.push_back(mode);
+
+    mode.name = "coarse4";
+    mode.settings = base;
+    mode.settings.matchScale = 4;
+    modes.push_back(mode);
+
+#ifdef RADSTITCH_WITH_CUDA
+    // Same feather on the device, PSNR against default is the CPU-GPU match
+    if(GpuStitcher::isAvailable()){
+        mode.name = "cuda";
+        mode.settings = base;
+        mode.gpu = true;
+        modes.push_back(mode);
+        mode.gpu = false;
+    }
+#endif
+
+    int cpus = std::max(1, cv::getNumberOfCPUs());
+    for (int threads = 1; ; threads *= 2) {
+        int n = std::min(threads, cpus);
+        std::ostringstream name;
+        name << "threads" << n;
+        mode.name = name.str();
+        mode.settings = base;
+        mode.settings.numThreads = n;
+        modes.push_back(mode);
+        if(n == cpus) break;
+    }
+
+    return modes;
+
+}
+
+
+// Full pipeline benchmark program
+// -----------------------------------------------------------------------------
+int main(int argc, char ** argv) {
+
+    int iterations = 5;
+    double focalLength = RadialStitcher::Settings().focalLength;
+    std::string variantList = "native,4k";
+    std::string referenceDir;
+    double minPsnr = 40;
+    const char * jsonOut = 0;
+
+    // Options come before inputs
+    int arg = 1;
+    while (arg < argc && !strncmp(argv[arg], "--", 2)) {
+        if(arg + 1 >= argc) usage(); // Every option takes a value
+        if(!strcmp(argv[arg], "--iterations")) iterations = std::max(1, atoi(argv[arg + 1]));
+        else if(!strcmp(argv[arg], "--focal")) focalLength = atof(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--variants")) variantList = argv[arg + 1];
+        else if(!strcmp(argv[arg], "--references")) referenceDir = argv[arg + 1];
+        else if(!strcmp(argv[arg], "--min-psnr")) minPsnr = atof(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--json")) jsonOut = argv[arg + 1];
+        else usage();
+        arg += 2;
+    }
+
+    std::vector<std::string> specs(argv + arg, argv + argc);
+    if(specs.empty()){ // Datasets shipped with the repo, run from cpp/
+        specs.push_back("../img/pano/la");
+        specs.push_back("../img/pano/sf");
+    }
+
+    // Frame widths of each variant, 0 keeps the set as shot
+    std::vector<std::string> variants;
+    std::vector<int> variantWidths;
+    std::stringstream list(variantList);
+    std::string variant;
+    while (std::getline(list, variant, ',')) {
+        if(variant == "native") variantWidths.push_back(0);
+        else if(variant == "4k") variantWidths.push_back(3840);
+        else if(variant == "8k") variantWidths.push_back(7680);
+        else usage();
+        variants.push_back(variant);
+    }
+
+    std::ofstream json;
+    if(jsonOut){
+        json.open(jsonOut, std::ios::trunc);
+        if(!json.is_open()){
+            std::cout << "Results " << jsonOut << " could not be written." << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Mode> modes = benchmarkModes();
+    int defaultThreads = cv::getNumThreads();
+    int failures = 0;
+
+    for (size_t s = 0; s < specs.size(); s++) {
+
+        Set shot;
+        if(loadSet(specs[s], focalLength, shot)) return 1;
+
+        for (size_t v = 0; v < variants.size(); v++) {
+
+            Set set;
+            if(variantWidths[v] > 0) upscaleSet(shot, variantWidths[v], set);
+            else set = shot;
+
+            std::cout << set.name << " " << variants[v] << ": " << set.images.size() << " images "
+                << set.images[0].cols << "x" << set.images[0].rows << ", focal " << set.focalLength << std::endl;
+
+            cv::Mat baseline; // Default mode output, for modes without a reference
+
+            for (size_t m = 0; m < modes.size(); m++) {
+
+                Result result;
+                cv::Mat panorama;
+                int status = runMode(set, modes[m], iterations, result, panorama);
+                cv::setNumThreads(defaultThreads); // Thread sweep modes set it process wide
+
+                if(status){
+                    std::cout << "    " << modes[m].name << " failed." << std::endl;
+                    failures++;
+                    continue;
+                }
+
+                // Stored reference when tracking regressions, else the default mode
+                cv::Mat reference = baseline;
+                bool recorded = false;
+                if(!referenceDir.empty()){
+                    std::string file = referenceDir + "/" + set.name + "_" + variants[v] + "_" + modes[m].name + ".png";
+                    reference = cv::imread(file, 1);
+                    if(!reference.data){
+                        recorded = cv::imwrite(file, panorama);
+                        reference = panorama;
+                    }
+                }
+                if(m == 0) baseline = panorama.clone();
+
+                result.psnr = comparePanoramas(panorama, reference);
+                bool regressed = !referenceDir.empty() && result.psnr < minPsnr;
+                if(regressed) failures++;
+
+                double megapixels = (double) result.canvas.area() * 1e-6;
+                std::cout << "    " << modes[m].name
+                    << ": prewarp " << result.prewarpMs << " ms, register " << result.registerMs
+                    << " ms, compose " << result.composeMs << " ms (" << 1000.0 / result.composeMs << " fps, "
+                    << megapixels * 1000.0 / result.composeMs << " Mpx/s), peak " << result.peakMb << " MB, PSNR ";
+                if(result.psnr < 0) std::cout << "n/a";
+                else std::cout << result.psnr << " dB";
+                if(recorded) std::cout << " (reference recorded)";
+                if(regressed) std::cout << " REGRESSION";
+                std::cout << std::endl;
+
+                if(json.is_open()){
+                    json << "{\"set\":\"" << set.name << "\",\"variant\":\"" << variants[v]
+                        << "\",\"mode\":\"" << modes[m].name << "\",\"images\":" << set.images.size()
+                        << ",\"canvas\":[" << result.canvas.width << "," << result.canvas.height << "]"
+                        << ",\"prewarp_ms\":" << result.prewarpMs << ",\"register_ms\":" << result.registerMs
+                        << ",\"compose_ms\":" << result.composeMs << ",\"peak_mb\":" << result.peakMb
+                        << ",\"psnr_db\":" << result.psnr << ",\"regressed\":" << (regressed ? "true" : "false")
+                        << "}" << std::endl;
+                }
+
+            }
+        }
+    }
+
+    if(failures) std::cout << failures << " runs failed or regressed." << std::endl;
+
+    return failures ? 1 : 0;
+
+}
@@ -0,0 +1,177 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Standard
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// OpenCV 3.1.0
+#include <opencv2/opencv.hpp>
+
+// Radial Stitcher
+#include "RadialStitcher.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// How to use this program
+// -----------------------------------------------------------------------------
+int usage(){
+    std::cout << std::endl;
+    std::cout << "Usage:" << std::endl;
+    std::cout << "    ./radStitchBlendBench [options] <image1> <image2> ... <imageN>" << std::endl;
+    std::cout << std::endl;
+    std::cout << "    Registers the images once, then times compose with every blend mode" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "    --iterations <N>         Composes timed per mode (default 10)" << std::endl;
+    std::cout << "    --focal <pixels>         Prewarp focal length (default 2800)" << std::endl;
+    std::cout << "    --blend-levels <N>       Multi-band pyramid levels (default 5)" << std::endl;
+    std::cout << "    --blend-band <rows>      Multi-band working band height (default 256)" << std::endl;
+    std::cout << std::endl;
+    exit(1);
+};
+
+
+// Average milliseconds per compose after one untimed warm up run that sizes
+// every buffer
+// -----------------------------------------------------------------------------
+static double timeCompose(RadialStitcher& rs, RadialStitcher::BlendMode mode, int iterations, cv::Mat& out){
+
+    RadialStitcher::Settings settings = rs.getSettings();
+    settings.blendMode = mode;
+    rs.setSettings(settings);
+
+    if(rs.compose(out)) return -1;
+
+    int64 start = cv::getTickCount();
+    for (int i = 0; i < iterations; i++) {
+        if(rs.compose(out)) return -1;
+    }
+
+    return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency() / iterations;
+
+}
+
+
+// Blend mode benchmark program
+// -----------------------------------------------------------------------------
+int main(int argc, char ** argv) {
+
+    int iterations = 10;
+    RadialStitcher::Settings settings;
+
+    // Options come before inputs
+    int arg = 1;
+    while (arg < argc && !strncmp(argv[arg], "--", 2)) {
+        if(arg + 1 >= argc) usage(); // Every option takes a value
+        if(!strcmp(argv[arg], "--iterations")) iterations = std::max(1, atoi(argv[arg + 1]));
+        else if(!strcmp(argv[arg], "--focal")) settings.focalLength = atof(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--blend-levels")) settings.blendLevels = atoi(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--blend-band")) settings.blendBandRows = atoi(argv[arg + 1]);
+        else usage();
+        arg += 2;
+    }
+
+    int numInputs = argc - arg;
+    if(numInputs < 2) usage(); // Need at least 2 images
+
+    RadialStitcher rs(numInputs, settings);
+    if(rs.readImages(argv + arg) || rs.estimateTransforms()){
+        std::cout << "Images could not be registered." << std::endl;
+        return 1;
+    }
+
+    cv::Size canvas = rs.getCanvasSize();
+    std::cout << "Canvas " << canvas.width << "x" << canvas.height << ", "
+        << iterations << " iterations per mode" << std::endl;
+
+    const int numModes = 4;
+    RadialStitcher::BlendMode modes[numModes] = {
+        RadialStitcher::FEATHER, RadialStitcher::FEATHER_REFERENCE, RadialStitcher::MULTIBAND, RadialStitcher::SEAM };
+    const char * names[numModes] = { "feather", "reference", "multiband", "seam" };
+
+    // Feather is the baseline the other modes are compared to
+    cv::Mat baseline;
+    for (int m = 0; m < numModes; m++) {
+
+        cv::Mat out;
+        double ms = timeCompose(rs, modes[m], iterations, out);
+        if(ms < 0){
+            std::cout << names[m] << " failed." << std::endl;
+            return 1;
+        }
+
+        if(m == 0) baseline = out.clone();
+        double difference = cv::norm(out, baseline, cv::NORM_L1) / ((double) out.total() * out.channels());
+
+        std::cout << names[m] << ": " << ms << " ms per frame, mean difference from feather "
+            << difference << " levels" << std::endl;
+
+    }
+
+    return 0;
+
+}
@@ -0,0 +1,143 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef FRAME_QUEUE_HPP
+#define FRAME_QUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Bounded blocking queue connecting pipeline stages. Producers block while the
+// queue is full so a fast stage can never run ahead of a slow one and memory
+// stays flat regardless of stream length.
+// -----------------------------------------------------------------------------
+template <typename T>
+class FrameQueue {
+
+    public:
+
+        FrameQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+        // Blocks while full, returns false if queue was closed
+        bool push(const T& item){
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [this]{ return closed || items.size() < capacity; });
+            if(closed) return false;
+            items.push_back(item);
+            notEmpty.notify_one();
+            return true;
+        }
+
+        // Blocks while empty, returns false once closed and drained
+        bool pop(T& item){
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this]{ return closed || !items.empty(); });
+            if(items.empty()) return false;
+            item = items.front();
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+        // Non-blocking variants, for pools of buffers handed back upstream
+        bool tryPush(const T& item){
+            std::lock_guard<std::mutex> lock(mutex);
+            if(closed || items.size() >= capacity) return false;
+            items.push_back(item);
+            notEmpty.notify_one();
+            return true;
+        }
+
+        bool tryPop(T& item){
+            std::lock_guard<std::mutex> lock(mutex);
+            if(items.empty()) return false;
+            item = items.front();
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+        // Wakes up every waiting stage, remaining items can still be popped
+        void close(){
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            notFull.notify_all();
+            notEmpty.notify_all();
+        }
+
+    private:
+
+        size_t capacity;
+        bool closed;
+        std::deque<T> items;
+        std::mutex mutex;
+        std::condition_variable notFull;
+        std::condition_variable notEmpty;
+
+};
+
+#endif
@@ -0,0 +1,337 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Standard
+#include <iostream>
+#include <vector>
+
+// OpenCV 3.1.0, CUDA modules
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/cuda.hpp>
+#include <opencv2/cudaarithm.hpp>
+#include <opencv2/cudaimgproc.hpp>
+#include <opencv2/cudawarping.hpp>
+
+// Radial Stitcher
+#include "GpuStitcher.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Canvas content the left neighbor's mask does not cover, e.g. from image
+// i - 2, keeps this weight so the new image only replaces it where it has data
+static const double residualWeight = 1e-3;
+
+
+GpuStitcher::GpuStitcher(){
+
+    numImages = 0;
+    ready = false;
+    interpolation = cv::INTER_NEAREST;
+
+}
+
+
+GpuStitcher::~GpuStitcher(){}
+
+
+bool GpuStitcher::isAvailable(){
+
+    return cv::cuda::getCudaEnabledDeviceCount() > 0;
+
+}
+
+
+// Uploads the stitcher's prewarp map, blend masks and placements, and
+// allocates every per frame buffer so stitch never allocates
+// Stitcher must hold a frame set and have transforms, it is prewarped here
+// -----------------------------------------------------------------------------
+int GpuStitcher::init(RadialStitcher& stitcher){
+
+    ready = false;
+
+    if(!isAvailable()){
+        std::cout << "No CUDA device available." << std::endl;
+        return -1;
+    }
+
+    const RadialStitcher::Settings& settings = stitcher.getSettings();
+    if(settings.stereo){
+        std::cout << "CUDA backend composes mono panoramas only." << std::endl;
+        return -1;
+    }
+
+    // Device only has the feather, every frame composed whole
+    if(settings.blendMode != RadialStitcher::FEATHER){
+        std::cout << "CUDA backend only feathers, ignoring the blend mode." << std::endl;
+    }
+    if(settings.refreshInterval > 0){
+        std::cout << "CUDA backend composes every frame whole, ignoring --incremental." << std::endl;
+    }
+
+    numImages = stitcher.getNumImages();
+    canvasSize = stitcher.getCanvasSize();
+    if(numImages < 1 || canvasSize.area() <= 0) return -1; // Not registered yet
+
+    imageSize = stitcher.getImageSize();
+    if(imageSize.area() <= 0) return -1; // Nothing registered yet
+    if(stitcher.prewarp()) return -1; // Masks below are the output scale prewarp's
+
+    // One map serves every camera, the rig shares a frame size. It also
+    // resamples to output scale, so projections come out at map size
+    cv::Mat hostMapX, hostMapY;
+    if(stitcher.getWarpMapFloat(imageSize, hostMapX, hostMapY, interpolation)) return -1;
+    mapX.upload(hostMapX);
+    mapY.upload(hostMapY);
+    projectedSize = hostMapX.size();
+
+    // Masks as float weights, blendLinear normalizes so only ratios matter
+    masks.resize(numImages);
+    for (int i = 0; i < numImages; i++) {
+
+        const cv::Mat& mask = stitcher.getBlendMask(i);
+        if(mask.size() != projectedSize) return -1;
+
+        double alphaMax = 1.0;
+        if(mask.depth() == CV_8U) alphaMax = 255.0;
+        else if(mask.depth() == CV_16U) alphaMax = 65535.0;
+
+        cv::Mat weight;
+        mask.convertTo(weight, CV_32FC1, 1.0 / alphaMax);
+        masks[i].upload(weight);
+
+    }
+
+    // Placements never change until the stitcher is registered again
+    if(stitcher.getTiles(tiles) || tiles.empty()) return -1;
+
+    patches.resize(tiles.size());
+    for (size_t t = 0; t < tiles.size(); t++) {
+        stitcher.getMaskPatches(tiles, (int) t, patches[t]);
+    }
+
+    // Streams and events must each be created, copies share the handle
+    uploads.clear();
+    deviceFrames.resize(numImages);
+    projected.resize(numImages);
+    warped.resize(numImages);
+    streams.clear();
+    projectedEvents.clear();
+
+    for (int i = 0; i < numImages; i++) {
+
+        uploads.push_back(cv::cuda::HostMem(imageSize.height, imageSize.width, CV_8UC3,
+            cv::cuda::HostMem::PAGE_LOCKED));
+        streams.push_back(cv::cuda::Stream());
+        projectedEvents.push_back(cv::cuda::Event(cv::cuda::Event::DISABLE_TIMING));
+
+        deviceFrames[i].create(imageSize, CV_8UC3);
+        projected[i].create(projectedSize, CV_8UC3);
+        warped[i].release();
+
+    }
+
+    // Exposure gains as measured at registration, applied after the remap
+    if(setGains(stitcher)) return -1;
+
+    canvasWeights.resize(tiles.size());
+    grays.resize(tiles.size());
+    planes.resize(tiles.size());
+    nonEmpty.resize(tiles.size());
+
+    for (size_t t = 0; t < tiles.size(); t++) {
+        cv::Size tile = tiles[t].canvasRect.size();
+        canvasWeights[t].create(tile, CV_32FC1);
+        grays[t].create(tile, CV_8UC1);
+        planes[t].create(3 * tile.height, tile.width, CV_8UC1);
+        nonEmpty[t].create(tile, CV_32FC1);
+    }
+
+    canvas.create(canvasSize, CV_8UC3);
+    download = cv::cuda::HostMem(canvasSize.height, canvasSize.width, CV_8UC3,
+        cv::cuda::HostMem::PAGE_LOCKED);
+
+    ready = true;
+
+    return 0;
+
+}
+
+
+// Uploads the stitcher's current gain tables, e.g. after it re-measured them
+// in video. Streams are idle between stitches so tables can be swapped here
+// -----------------------------------------------------------------------------
+int GpuStitcher::setGains(RadialStitcher& stitcher){
+
+    if(stitcher.getNumImages() != numImages) return -1;
+
+    gainTables.assign(numImages, cv::Ptr<cv::cuda::LookUpTable>());
+    for (int i = 0; i < numImages; i++) {
+        const cv::Mat& table = stitcher.getGainTable(i);
+        if(table.empty()) continue;
+        gainTables[i] = cv::cuda::createLookUpTable(table);
+        if(warped[i].empty()) warped[i].create(projectedSize, CV_8UC3); // First tables since init
+    }
+
+    return 0;
+
+}
+
+
+// Uploads and projects every camera on its own stream, then places and
+// feathers tiles in order on the compose stream as each projection lands
+// -----------------------------------------------------------------------------
+int GpuStitcher::stitch(const std::vector<cv::Mat>& images, cv::Mat& panorama){
+
+    if(!ready || (int) images.size() != numImages) return -1;
+
+    for (int i = 0; i < numImages; i++) {
+
+        if(images[i].size() != imageSize || images[i].type() != CV_8UC3){
+            std::cout << "Frame size does not match GPU layout." << std::endl;
+            return -1;
+        }
+
+        // Device reads from pinned memory asynchronously, the previous frame's
+        // upload finished before last stitch returned so the buffer is free
+        cv::Mat staging = uploads[i].createMatHeader();
+        images[i].copyTo(staging);
+
+        deviceFrames[i].upload(staging, streams[i]);
+        if(gainTables[i]){
+            cv::cuda::remap(deviceFrames[i], warped[i], mapX, mapY, interpolation,
+                cv::BORDER_CONSTANT, cv::Scalar(), streams[i]);
+            gainTables[i]->transform(warped[i], projected[i], streams[i]);
+        } else {
+            cv::cuda::remap(deviceFrames[i], projected[i], mapX, mapY, interpolation,
+                cv::BORDER_CONSTANT, cv::Scalar(), streams[i]);
+        }
+        projectedEvents[i].record(streams[i]);
+
+    }
+
+    canvas.setTo(cv::Scalar::all(0), composeStream);
+
+    for (size_t t = 0; t < tiles.size(); t++) {
+
+        const RadialStitcher::Tile& tile = tiles[t];
+        composeStream.waitEvent(projectedEvents[tile.image]);
+
+        if(t == 0){
+            projected[tile.image](tile.imageRect).copyTo(canvas(tile.canvasRect), composeStream);
+        } else if(blendTile((int) t)){
+            return -1;
+        }
+
+    }
+
+    cv::Mat host = download.createMatHeader();
+    canvas.download(host, composeStream);
+    composeStream.waitForCompletion();
+
+    host.copyTo(panorama); // Staging buffer is overwritten by the next frame, reuses a sized panorama
+
+    return 0;
+
+}
+
+
+// Feathers a projected tile into the canvas over its own rectangle. Canvas
+// weight is the neighbors' masks where they were placed, other drawn content
+// keeps a residual weight and empty canvas gets none
+// -----------------------------------------------------------------------------
+int GpuStitcher::blendTile(int t){
+
+    const RadialStitcher::Tile& placed = tiles[t];
+
+    cv::cuda::GpuMat tile = canvas(placed.canvasRect);
+    cv::cuda::GpuMat tileNew = projected[placed.image](placed.imageRect);
+    cv::cuda::GpuMat tileNewMask = masks[placed.image](placed.imageRect);
+    cv::cuda::GpuMat& weight = canvasWeights[t];
+
+    weight.setTo(cv::Scalar::all(0), composeStream);
+    for (size_t p = 0; p < patches[t].size(); p++) {
+        const RadialStitcher::MaskPatch& patch = patches[t][p];
+        cv::cuda::GpuMat target = weight(patch.target);
+        cv::cuda::max(target, masks[patch.image](patch.source), target, composeStream);
+    }
+
+    // Anything already drawn - any channel above 0 - keeps at least the
+    // residual weight, black canvas gets none even inside a neighbor's mask
+    // (projection corners) so the new image is taken there as it is on the CPU
+    int rows = placed.canvasRect.height;
+    cv::cuda::GpuMat channels[3];
+    for (int c = 0; c < 3; c++) channels[c] = planes[t].rowRange(c * rows, (c + 1) * rows);
+    cv::cuda::split(tile, channels, composeStream);
+    cv::cuda::max(channels[0], channels[1], grays[t], composeStream);
+    cv::cuda::max(grays[t], channels[2], grays[t], composeStream);
+    cv::cuda::threshold(grays[t], grays[t], 0, 1, cv::THRESH_BINARY, composeStream);
+    grays[t].convertTo(nonEmpty[t], CV_32FC1, composeStream);
+    cv::cuda::max(weight, cv::Scalar::all(residualWeight), weight, composeStream);
+    cv::cuda::multiply(weight, nonEmpty[t], weight, 1, -1, composeStream);
+
+    cv::cuda::blendLinear(tile, tileNew, weight, tileNewMask, tile, composeStream);
+
+    return 0;
+
+}
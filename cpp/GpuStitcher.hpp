@@ -0,0 +1,148 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GPU_STITCHER_HPP
+#define GPU_STITCHER_HPP
+
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/cuda.hpp>
+#include <opencv2/cudaarithm.hpp>
+
+#include "RadialStitcher.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// GPU Stitcher Class replays a registered RadialStitcher layout on a CUDA
+// device. Frames are uploaded once through pinned staging buffers, then
+// projection, placement and feathering all run on device memory and only the
+// finished panorama is downloaded. Each camera has its own stream so uploads
+// and projections of later cameras overlap blending of earlier ones.
+// -----------------------------------------------------------------------------
+class GpuStitcher {
+
+    public:
+
+        GpuStitcher();
+        ~GpuStitcher();
+
+        // True when OpenCV was built with CUDA and a device is present
+        static bool isAvailable();
+
+        // Copies warp maps, masks and placements to the device, call again
+        // whenever the stitcher's transforms change
+        int init(RadialStitcher& stitcher);
+        bool isReady() const { return ready; }
+
+        // Replaces the exposure tables with the stitcher's current ones
+        int setGains(RadialStitcher& stitcher);
+
+        // Warp and blend one raw frame set, frames must match the init size
+        int stitch(const std::vector<cv::Mat>& frames, cv::Mat& panorama);
+
+    private:
+
+        // Stitcher Parameters
+        int numImages;
+        bool ready;
+        cv::Size imageSize; // Input frames
+        cv::Size projectedSize; // Prewarped at output scale
+        cv::Size canvasSize;
+        int interpolation; // Nearest at native scale, bilinear when resampling
+
+        // Layout from the registered stitcher
+        std::vector<RadialStitcher::Tile> tiles;
+        std::vector<std::vector<RadialStitcher::MaskPatch> > patches; // Per tile
+
+        // Device resident tables, uploaded once
+        cv::cuda::GpuMat mapX, mapY; // Shared prewarp map, CV_32FC1 at output scale
+        std::vector<cv::cuda::GpuMat> masks; // Prewarped alpha, CV_32FC1 in [0, 1]
+        std::vector<cv::Ptr<cv::cuda::LookUpTable> > gainTables; // Exposure gains, empty when off
+
+        // Per camera staging and work buffers, allocated once in init
+        std::vector<cv::cuda::HostMem> uploads; // Page locked so copies run async
+        std::vector<cv::cuda::GpuMat> deviceFrames;
+        std::vector<cv::cuda::GpuMat> projected;
+        std::vector<cv::cuda::GpuMat> warped; // Projected before gain, only with gain tables
+        std::vector<cv::cuda::Stream> streams;
+        std::vector<cv::cuda::Event> projectedEvents;
+
+        // Per tile blend scratch, indexed like tiles
+        std::vector<cv::cuda::GpuMat> canvasWeights;
+        std::vector<cv::cuda::GpuMat> grays; // Any channel above 0, as the CPU blenders test
+        std::vector<cv::cuda::GpuMat> planes; // Tile's three channels stacked, CV_8UC1
+        std::vector<cv::cuda::GpuMat> nonEmpty;
+
+        // Output
+        cv::cuda::Stream composeStream;
+        cv::cuda::GpuMat canvas;
+        cv::cuda::HostMem download;
+
+        // Auxiliary functions
+        int blendTile(int t);
+
+};
+
+#endif
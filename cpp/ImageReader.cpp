@@ -0,0 +1,248 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Standard
+#include <cctype>
+#include <cstdio>
+#include <iostream>
+#ifdef RADSTITCH_WITH_LIBJPEG
+#include <csetjmp>
+extern "C" {
+#include <jpeglib.h>
+}
+#endif
+
+// OpenCV 3.1.0
+#include <opencv2/opencv.hpp>
+
+// Radial Stitcher
+#include "ImageReader.hpp"
+#include "ParallelFor.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef RADSTITCH_WITH_LIBJPEG
+
+// libjpeg reports fatal errors through a callback that must not return
+// -----------------------------------------------------------------------------
+struct JpegError {
+    jpeg_error_mgr manager;
+    jmp_buf jump;
+};
+
+
+static void jpegErrorExit(j_common_ptr info){
+
+    char message[JMSG_LENGTH_MAX];
+    info->err->format_message(info, message);
+    std::cout << "JPEG decode failed: " << message << std::endl;
+
+    longjmp(((JpegError *) info->err)->jump, 1);
+
+}
+
+
+// Decodes a color JPEG into image, scaled in the DCT domain. Returns 1 for
+// files it leaves to cv::imread, grayscale and CMYK ones
+// -----------------------------------------------------------------------------
+static int decodeJpeg(const std::string& name, cv::Mat& image, int scale){
+
+    FILE * file = fopen(name.c_str(), "rb");
+    if(!file) return -1;
+
+    jpeg_decompress_struct info;
+    JpegError error;
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpegErrorExit;
+
+    if(setjmp(error.jump)){
+        jpeg_destroy_decompress(&info);
+        fclose(file);
+        return -1;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_stdio_src(&info, file);
+    jpeg_read_header(&info, TRUE);
+
+    if(info.num_components != 3){
+        jpeg_destroy_decompress(&info);
+        fclose(file);
+        return 1;
+    }
+
+    info.scale_num = 1;
+    info.scale_denom = scale;
+#ifdef JCS_EXTENSIONS
+    info.out_color_space = JCS_EXT_BGR; // libjpeg-turbo writes OpenCV order directly
+#else
+    info.out_color_space = JCS_RGB;
+#endif
+    jpeg_start_decompress(&info);
+
+    image.create(info.output_height, info.output_width, CV_8UC3);
+    while (info.output_scanline < info.output_height) {
+        JSAMPROW row = image.ptr<uchar>(info.output_scanline);
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    fclose(file);
+
+#ifndef JCS_EXTENSIONS
+    cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+#endif
+
+    return 0;
+
+}
+
+
+// JPEGs by their extension
+// -----------------------------------------------------------------------------
+static bool isJpeg(const std::string& name){
+
+    size_t dot = name.find_last_of('.');
+    if(dot == std::string::npos) return false;
+
+    std::string ext = name.substr(dot + 1);
+    for (size_t c = 0; c < ext.size(); c++) ext[c] = (char) tolower(ext[c]);
+
+    return ext == "jpg" || ext == "jpeg";
+
+}
+
+#endif
+
+
+// Initialize reader parameters
+ImageReader::ImageReader(int scale){
+
+    this->scale = scale;
+
+}
+
+
+// Size of an image decoded at 1/scale
+// -----------------------------------------------------------------------------
+cv::Size ImageReader::scaledSize(cv::Size size, int scale){
+
+    return cv::Size((size.width + scale - 1) / scale, (size.height + scale - 1) / scale);
+
+}
+
+
+// Decodes one file as 8 bit BGR at 1/scale size
+// -----------------------------------------------------------------------------
+int ImageReader::decode(const std::string& name, cv::Mat& image, int scale){
+
+#ifdef RADSTITCH_WITH_LIBJPEG
+    if(isJpeg(name)){
+        int status = decodeJpeg(name, image, scale);
+        if(status <= 0) return status;
+    }
+#endif
+
+    cv::Mat decoded = cv::imread(name, 1);
+    if(!decoded.data) return -1;
+
+    if(scale == 1){
+        image = decoded; // imread allocates its own buffer anyway
+    } else {
+        cv::resize(decoded, image, scaledSize(decoded.size(), scale), 0, 0, cv::INTER_AREA);
+    }
+
+    return 0;
+
+}
+
+
+// Decodes a frame set, one file per task
+// -----------------------------------------------------------------------------
+int ImageReader::read(const std::vector<std::string>& names, std::vector<cv::Mat>& images){
+
+    int numImages = (int) names.size();
+    images.resize(numImages);
+
+    std::vector<int> status(numImages);
+    parallelFor(numImages, [&](int i){ status[i] = decode(names[i], images[i], scale); });
+
+    for (int i = 0; i < numImages; i++) {
+        if(status[i]){
+            std::cout << "Image " << names[i] << " could not be read." << std::endl;
+            return -1;
+        }
+    }
+
+    return 0;
+
+}
+
+
+int ImageReader::read(int numImages, const char * const * names, std::vector<cv::Mat>& images){
+
+    return read(std::vector<std::string>(names, names + numImages), images);
+
+}
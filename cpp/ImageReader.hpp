@@ -0,0 +1,104 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef IMAGE_READER_HPP
+#define IMAGE_READER_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Image Reader decodes a frame set, every file in parallel, into buffers kept
+// from the previous set. Built with libjpeg (-DRADSTITCH_WITH_LIBJPEG), JPEGs
+// are decoded straight into the buffer rows, and a reduced size is produced by
+// the decoder's DCT scaling, which skips most of the work instead of decoding
+// at full size and shrinking. Other formats, or builds without libjpeg, go
+// through cv::imread and are shrunk with area averaging to the same size.
+// -----------------------------------------------------------------------------
+class ImageReader {
+
+    public:
+
+        ImageReader(int scale = 1); // Decode at 1/scale, 1, 2, 4 or 8
+
+        // Decodes names[i] into images[i], reusing its memory when the size
+        // already matches. Nonzero if any file could not be read
+        int read(const std::vector<std::string>& names, std::vector<cv::Mat>& images);
+        int read(int numImages, const char * const * names, std::vector<cv::Mat>& images);
+
+        static int decode(const std::string& name, cv::Mat& image, int scale = 1);
+        static cv::Size scaledSize(cv::Size size, int scale); // Rounds up like the decoder
+
+        int getScale() const { return scale; }
+
+    private:
+
+        int scale;
+
+};
+
+#endif
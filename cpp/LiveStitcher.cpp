@@ -0,0 +1,342 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Standard
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+// OpenCV 3.1.0
+#include <opencv2/opencv.hpp>
+
+// Radial Stitcher
+#include "LiveStitcher.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+const int LiveStitcher::previewWidth;
+const int LiveStitcher::stopTimeout;
+
+
+// Preview settings, output is shrunk in the warp unless a width was asked for
+// -----------------------------------------------------------------------------
+static RadialStitcher::Settings previewSettings(const RadialStitcher::Settings& settings, int width){
+
+    RadialStitcher::Settings preview = settings;
+    if(preview.outputWidth <= 0) preview.outputWidth = width;
+    return preview;
+
+}
+
+
+// Initialize pipeline parameters, streams are opened when the preview runs
+LiveStitcher::LiveStitcher(int numInputs, char ** inputNames, const RadialStitcher::Settings& settings)
+    : stitcher(numInputs, previewSettings(settings, previewWidth)) {
+
+    this->numInputs = numInputs;
+    fps = 30;
+    maxSkew = 0;
+    misaligned = 0;
+
+    for (int i = 0; i < numInputs; i++) this->inputNames.push_back(inputNames[i]);
+
+}
+
+
+LiveStitcher::~LiveStitcher(){}
+
+
+int LiveStitcher::loadCalibration(const std::string& fileName){
+
+    return stitcher.loadCalibration(fileName);
+
+}
+
+
+// Opens every stream. All digit names are capture devices, names without a
+// scheme are camera hosts serving the SJ4000 live view
+// -----------------------------------------------------------------------------
+int LiveStitcher::openInputs(){
+
+    captures.clear();
+
+    for (int i = 0; i < numInputs; i++) {
+
+        std::string name = inputNames[i];
+
+        bool isDevice = !name.empty();
+        for (size_t c = 0; c < name.size(); c++) {
+            if(!isdigit(name[c])) isDevice = false;
+        }
+        if(!isDevice && name.find("://") == std::string::npos) name = "rtsp://" + name + "/sjcam.mov";
+
+        cv::Ptr<cv::VideoCapture> capture = cv::makePtr<cv::VideoCapture>();
+        if(isDevice) capture->open(atoi(name.c_str()));
+        else capture->open(name);
+
+        if(!capture->isOpened()){
+            std::cout << "Stream " << name << " could not be opened." << std::endl;
+            return -1;
+        }
+
+        captures.push_back(capture);
+
+    }
+
+    // Cameras free run at the same nominal rate with unrelated phases, so the
+    // latest frames are up to a period apart even when nothing is late
+    double inputFps = captures[0]->get(cv::CAP_PROP_FPS);
+    if(inputFps > 0 && inputFps < 1000) fps = inputFps;
+    maxSkew = (int64) (cv::getTickFrequency() / fps);
+
+    feed = cv::makePtr<Feed>();
+    feed->stopping = false;
+    feed->overwritten = 0;
+    feed->slots.assign(numInputs, Slot());
+    for (int i = 0; i < numInputs; i++) {
+        feed->slots[i].stamp = 0;
+        feed->slots[i].fresh = false;
+        feed->slots[i].ended = false;
+    }
+
+    return 0;
+
+}
+
+
+// Capture stage, one thread per camera. Frames are stamped when their packet
+// is grabbed, before decode, and replace whatever is still in the slot.
+// Stopping is checked after every grab, a stalled stream blocks in grab until
+// the network gives up, so Run does not wait for it past stopTimeout
+// -----------------------------------------------------------------------------
+void LiveStitcher::capture(cv::Ptr<Feed> feed, cv::Ptr<cv::VideoCapture> capture, int input){
+
+    cv::Mat frame;
+
+    while (capture->grab()) {
+
+        int64 stamp = cv::getTickCount();
+        {
+            std::lock_guard<std::mutex> lock(feed->mutex);
+            if(feed->stopping) break;
+        }
+        if(!capture->retrieve(frame)) break;
+
+        std::lock_guard<std::mutex> lock(feed->mutex);
+        if(feed->stopping) break;
+
+        Slot& slot = feed->slots[input];
+        if(slot.fresh) feed->overwritten++;
+        slot.frame = frame;
+        slot.stamp = stamp;
+        slot.fresh = true;
+        feed->frameReady.notify_all();
+
+        frame.release(); // Slot keeps its buffer, decode into a new one
+
+    }
+
+    std::lock_guard<std::mutex> lock(feed->mutex);
+    feed->slots[input].ended = true;
+    feed->frameReady.notify_all();
+
+}
+
+
+// Waits for a fresh frame from every camera, all within maxSkew of the newest.
+// Older ones are dropped and replaced by their camera's next frame
+// -----------------------------------------------------------------------------
+int LiveStitcher::waitForSet(std::vector<cv::Mat>& frames){
+
+    std::unique_lock<std::mutex> lock(feed->mutex);
+    std::vector<Slot>& slots = feed->slots;
+
+    while (true) {
+
+        feed->frameReady.wait(lock, [this, &slots]{
+            for (int i = 0; i < numInputs; i++) {
+                if(slots[i].ended) return true;
+                if(!slots[i].fresh) return false;
+            }
+            return true;
+        });
+
+        for (int i = 0; i < numInputs; i++) {
+            if(slots[i].ended) return -1;
+        }
+
+        int64 newest = 0;
+        for (int i = 0; i < numInputs; i++) newest = std::max(newest, slots[i].stamp);
+
+        bool aligned = true;
+        for (int i = 0; i < numInputs; i++) {
+            if(newest - slots[i].stamp <= maxSkew) continue;
+            slots[i].fresh = false; // Too old to pair with the rest
+            aligned = false;
+        }
+
+        if(!aligned){
+            misaligned++;
+            continue;
+        }
+
+        for (int i = 0; i < numInputs; i++) {
+            frames[i] = slots[i].frame;
+            slots[i].fresh = false;
+        }
+
+        return 0;
+
+    }
+
+}
+
+
+// Runs capture -> warp -> blend -> show on the calibrated fast path, stitching
+// on this thread. The calibration is scaled to the stream resolution on the
+// first set
+// -----------------------------------------------------------------------------
+int LiveStitcher::Run(const PreviewSink& show){
+
+    if(!stitcher.isCalibrated()){
+        std::cout << "Live preview needs a calibration, pass --calib." << std::endl;
+        return -1;
+    }
+
+    if(openInputs()) return -1;
+
+    std::cout << "Previewing " << numInputs << " streams, press Esc to stop..." << std::endl;
+
+    std::vector<std::thread> capturers;
+    for (int i = 0; i < numInputs; i++) {
+        capturers.push_back(std::thread(&LiveStitcher::capture, feed, captures[i], i));
+    }
+
+    int status = 0;
+    int numFrames = 0;
+    int64 start = cv::getTickCount();
+
+    std::vector<cv::Mat> frames(numInputs);
+    cv::Mat panorama; // Shown before the next compose, so always reused
+    Profiler& profiler = stitcher.getProfiler();
+
+    while (waitForSet(frames) == 0) {
+
+        if(numFrames == 0 && stitcher.scaleCalibration(frames[0].size())){
+            status = -1;
+            break;
+        }
+
+        Profiler::Mark frameStart = profiler.mark();
+        if(stitcher.setImages(frames) || stitcher.compose(panorama)){
+            std::cout << "Frame " << numFrames << " could not be stitched." << std::endl;
+            status = -1;
+            break;
+        }
+        profiler.frame(numFrames, frameStart, stitcher.getAllocationCount(), stitcher.getAllocatedBytes());
+
+        numFrames++;
+        if(!show(panorama)) break;
+
+    }
+
+    // Capture threads stop at their next frame, or when their stream ends.
+    // One still blocked in a stalled stream after stopTimeout is detached, it
+    // owns what it touches and returns when the network times out
+    int stalled = 0;
+    {
+        std::unique_lock<std::mutex> lock(feed->mutex);
+        feed->stopping = true;
+        std::vector<Slot>& slots = feed->slots;
+        feed->frameReady.wait_for(lock, std::chrono::milliseconds(stopTimeout), [this, &slots]{
+            for (int i = 0; i < numInputs; i++) {
+                if(!slots[i].ended) return false;
+            }
+            return true;
+        });
+        for (int i = 0; i < numInputs; i++) {
+            if(slots[i].ended) continue;
+            capturers[i].detach();
+            stalled++;
+        }
+    }
+    for (int i = 0; i < numInputs; i++) {
+        if(capturers[i].joinable()) capturers[i].join();
+    }
+    if(stalled) std::cout << stalled << " stalled streams left to time out." << std::endl;
+    captures.clear();
+
+    double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+    std::cout << numFrames << " previews in " << seconds << " s";
+    if(seconds > 0) std::cout << " (" << numFrames / seconds << " fps)";
+    std::cout << ", " << feed->overwritten << " frames dropped while stitching, " << misaligned
+        << " sets dropped for a late frame" << std::endl;
+    profiler.summary();
+
+    return status;
+
+}
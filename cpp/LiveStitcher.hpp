@@ -0,0 +1,148 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef LIVE_STITCHER_HPP
+#define LIVE_STITCHER_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "RadialStitcher.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Live Stitcher Class previews a calibrated rig from its live streams, e.g. the
+// SJ4000 RTSP live view, so alignment can be checked on set. Every camera is
+// read on its own thread into a single slot that always holds its latest
+// frame, so a slow stitch drops frames instead of queueing them and latency
+// stays bounded. A set is only stitched when every camera's frame arrived within
+// one frame period of the newest, a late frame is dropped and its camera's next
+// one awaited.
+// -----------------------------------------------------------------------------
+class LiveStitcher {
+
+    public:
+
+        // Gets every preview panorama, returns false to stop
+        typedef std::function<bool(const cv::Mat& panorama)> PreviewSink;
+
+        // Inputs are stream URLs, capture device numbers, or camera hosts that
+        // become rtsp://<host>/sjcam.mov. Output width defaults to a preview size
+        LiveStitcher(int numInputs, char ** inputNames,
+            const RadialStitcher::Settings& settings = RadialStitcher::Settings());
+        ~LiveStitcher();
+
+        int loadCalibration(const std::string& fileName); // Required, live frames are never registered
+        int Run(const PreviewSink& show); // Until show declines or a stream ends
+
+        Profiler& getProfiler() { return stitcher.getProfiler(); }
+
+    private:
+
+        // Latest frame of one camera
+        struct Slot {
+            cv::Mat frame;
+            int64 stamp; // Tick count when it arrived
+            bool fresh; // Not stitched yet
+            bool ended; // Its capture thread returned
+        };
+
+        // Everything capture threads touch. Threads hold it and their capture
+        // themselves, so one stuck in a stalled stream can be left to time out
+        // after Run returns
+        struct Feed {
+            std::mutex mutex;
+            std::condition_variable frameReady;
+            std::vector<Slot> slots;
+            bool stopping;
+            int overwritten; // Frames replaced before they were stitched
+        };
+
+        // Pipeline Parameters
+        int numInputs;
+        double fps;
+        int64 maxSkew; // Ticks between the first and last frame of a set
+        static const int previewWidth = 1280;
+
+        std::vector<std::string> inputNames;
+        RadialStitcher stitcher;
+        std::vector<cv::Ptr<cv::VideoCapture> > captures;
+
+        cv::Ptr<Feed> feed;
+        int misaligned; // Sets dropped for a late frame
+        static const int stopTimeout = 2000; // ms a capture thread gets to notice stopping
+
+        // Auxiliary functions
+        int openInputs();
+        static void capture(cv::Ptr<Feed> feed, cv::Ptr<cv::VideoCapture> capture, int input);
+        int waitForSet(std::vector<cv::Mat>& frames);
+
+};
+
+#endif
@@ -0,0 +1,221 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Standard
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+// OpenCV 3.1.0
+#include <opencv2/opencv.hpp>
+
+// Radial Stitcher
+#include "Profiler.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+Profiler::Profiler(){
+
+    enabled.store(false);
+
+}
+
+
+Profiler::~Profiler(){
+
+    close();
+
+}
+
+
+// Starts writing events to fileName, replacing it
+// -----------------------------------------------------------------------------
+int Profiler::open(const std::string& fileName){
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    file.open(fileName.c_str(), std::ios::trunc);
+    if(!file.is_open()){
+        std::cout << "Profile " << fileName << " could not be written." << std::endl;
+        return -1;
+    }
+
+    latencies.clear();
+    enabled.store(true);
+
+    return 0;
+
+}
+
+
+void Profiler::close(){
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    enabled.store(false);
+    if(file.is_open()) file.close();
+
+}
+
+
+// Reads the clocks only when enabled
+// -----------------------------------------------------------------------------
+Profiler::Mark Profiler::mark() const{
+
+    Mark m;
+    bool on = isEnabled();
+    m.wall = on ? cv::getTickCount() : 0;
+    m.cpu = on ? std::clock() : 0;
+
+    return m;
+
+}
+
+
+void Profiler::stage(const char* name, const Mark& since, int image, const char* counter, double value){
+
+    if(!isEnabled()) return;
+
+    std::ostringstream line;
+    line << "{\"event\":\"stage\",\"stage\":\"" << name << "\"";
+    if(image >= 0) line << ",\"image\":" << image;
+    line << ",\"wall_ms\":" << wallMs(since) << ",\"cpu_ms\":" << cpuMs(since);
+    if(counter) line << ",\"" << counter << "\":" << value;
+    line << "}";
+
+    write(line.str());
+
+}
+
+
+void Profiler::frame(int index, const Mark& since, int64 allocations, int64 allocatedBytes){
+
+    if(!isEnabled()) return;
+
+    double latency = wallMs(since);
+
+    std::ostringstream line;
+    line << "{\"event\":\"frame\",\"index\":" << index << ",\"latency_ms\":" << latency
+        << ",\"cpu_ms\":" << cpuMs(since) << ",\"allocations\":" << allocations
+        << ",\"allocated_bytes\":" << allocatedBytes << "}";
+
+    std::lock_guard<std::mutex> lock(mutex);
+    latencies.push_back(latency);
+    if(file.is_open()) file << line.str() << "\n";
+
+}
+
+
+// Nearest rank percentiles of frame latency
+// -----------------------------------------------------------------------------
+void Profiler::summary(){
+
+    if(!isEnabled()) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<double> sorted(latencies);
+    std::sort(sorted.begin(), sorted.end());
+
+    std::ostringstream line;
+    line << "{\"event\":\"summary\",\"frames\":" << sorted.size();
+
+    if(!sorted.empty()){
+        const int ranks[3] = { 50, 90, 99 };
+        line << ",\"latency_ms\":{";
+        for (int r = 0; r < 3; r++) {
+            size_t k = (size_t) std::max(0.0, ceil(ranks[r] / 100.0 * sorted.size()) - 1);
+            line << "\"p" << ranks[r] << "\":" << sorted[k] << ",";
+        }
+        line << "\"max\":" << sorted.back() << "}";
+    }
+
+    line << "}";
+
+    if(file.is_open()) file << line.str() << std::endl;
+
+}
+
+
+void Profiler::write(const std::string& line){
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(file.is_open()) file << line << "\n";
+
+}
+
+
+double Profiler::wallMs(const Mark& since){
+
+    return (cv::getTickCount() - since.wall) * 1000.0 / cv::getTickFrequency();
+
+}
+
+
+double Profiler::cpuMs(const Mark& since){
+
+    return (std::clock() - since.cpu) * 1000.0 / CLOCKS_PER_SEC;
+
+}
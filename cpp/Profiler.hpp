@@ -0,0 +1,125 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <atomic>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Stage timing and counters written as JSON lines, one object per event.
+// Disabled until open succeeds; marks and events then cost one branch, so
+// instrumentation can stay in the hot paths. Safe to use from any thread.
+// CPU time is the whole process's, so it includes parallel workers
+// -----------------------------------------------------------------------------
+class Profiler {
+
+    public:
+
+        // Point in time a stage started
+        struct Mark {
+            int64 wall; // cv::getTickCount
+            std::clock_t cpu;
+        };
+
+        Profiler();
+        ~Profiler();
+
+        int open(const std::string& fileName); // Enables output
+        void close();
+        bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+        Mark mark() const;
+
+        // One line per stage run, image is -1 for whole frame set stages and
+        // the right image of a pair otherwise. counter names one count to report
+        void stage(const char* name, const Mark& since, int image = -1, const char* counter = 0, double value = 0);
+
+        // Video frame done, its latency joins the summary percentiles
+        void frame(int index, const Mark& since, int64 allocations, int64 allocatedBytes);
+        void summary(); // Latency percentiles over every frame so far
+
+    private:
+
+        std::atomic<bool> enabled; // Probes read it from worker threads, relaxed is one plain load
+        std::ofstream file;
+        std::mutex mutex;
+        std::vector<double> latencies; // ms, one per frame
+
+        // Auxiliary functions
+        void write(const std::string& line);
+        static double wallMs(const Mark& since);
+        static double cpuMs(const Mark& since);
+
+};
+
+#endif
@@ -62,9 +62,22 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 // Standard
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <climits>
+#include <mutex>
+#include <unordered_map>
+
+// SIMD
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 // OpenCV 3.1.0
 #include <opencv2/opencv.hpp>
@@ -72,456 +85,610 @@
 #include <opencv2/features2d/features2d.hpp>
 
 // Radial Stitcher
+#include "ImageReader.hpp"
+#include "ParallelFor.hpp"
 #include "RadialStitcher.hpp"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 
-// Initialize stitcher parameters and prewarp images
-RadialStitcher::RadialStitcher(int numImages, char ** fileNames){
+// Prewarped size of a frame, warp maps round the same way
+// -----------------------------------------------------------------------------
+static cv::Size scaledSize(cv::Size size, double scale){
+
+    if(scale == 1.0) return size;
+
+    return cv::Size(cvRound(size.width * scale), cvRound(size.height * scale));
+
+}
+
+
+// Initialize stitcher parameters only, frames are provided with setImages
+RadialStitcher::RadialStitcher(int numImages, const Settings& settings){
+
+    init(numImages, settings);
+
+}
+
+
+// Default stitcher parameters
+RadialStitcher::Settings::Settings(){
 
-    // Initialize stitcher parameters...
-    this->numImages = numImages;
     projection = SPHERICAL;
     focalLength = 2800; // LA Skyline (300mm)
+    useWarpMaps = true;
+    bilinear = false;
+    overlapOnly = false;
+    overlapFraction = 0.5; // Same as canvas sizing in estimateTransforms
+    matchScale = 1;
+    decodeScale = 1;
+    matcher = BRUTE_FORCE;
+    matchFilter = RATIO_TEST;
+    ratio = 0.8;
+    maxMatchTime = 0;
+    estimator = HISTOGRAM;
+    confidence = 0.99;
+    minInliers = 4;
+    blendMode = FEATHER;
+    blendLevels = 5;
+    blendBandRows = 256;
+    seamBand = 16;
+    seamWindow = 24;
+    maskDepth = CV_16U;
+    numThreads = 0;
+    closeLoop = false;
+    outputWidth = 0;
+    exposure = EXPOSURE_NONE;
+    gainInterval = 15;
+    gainSmoothing = 0.2;
+    stereo = false;
+    stereoOffset = 0.1;
+    refreshInterval = 0;
+    changeThreshold = 4;
 
-    // ...and warp and store input images
-    for (int i = 0; i < numImages; i++) {
+}
 
-        cv::Mat temp = cv::imread(fileNames[i + 1], 1);
-        cv::Mat mask = cv::Mat::zeros(temp.rows, temp.cols, CV_64F);
-        buildBlendMask(temp, mask);
 
-        if(!temp.data){ // Image is legit?
-            std::cout << "Images could not be read." << std::endl;
-            exit(1);
-        }
+// Initialize stitcher parameters...
+void RadialStitcher::init(int numImages, const Settings& settings){
 
-        src.push_back(cv::Mat::zeros(temp.rows, temp.cols, temp.type()));
-        blendMasks.push_back(cv::Mat::zeros(mask.rows, mask.cols, mask.type()));
+    this->numImages = numImages;
+    this->settings = settings;
+    this->settings.focalLength /= settings.decodeScale; // Frames are that much smaller
+    calibrated = false;
+
+    matchBudget = 0;
+
+    src.resize(numImages);
+    blendMasks.resize(numImages);
+    frames.resize(numImages);
+    detectors.resize(numImages);
+    coarse.resize(numImages);
+    prewarpStatus.resize(numImages);
+    allocations = 0;
+    allocatedBytes = 0;
+    srcScale = 1.0;
+    outputScale = 1.0;
+    gains.assign(numImages, cv::Vec3d(1, 1, 1));
+    gainTables.resize(numImages);
+    framesSinceGains = 0;
+    warpCache = cv::makePtr<WarpCache>();
+    eye = -1;
+    framesSinceRefresh = 0;
+    tracking = false;
+    srcStale = false;
 
-        // Project image and its blend mask
-        if(projection == SPHERICAL){
-            RadialStitcher::projectSpherical(temp, src[i], focalLength);
-            RadialStitcher::projectMaskSpherical(mask, blendMasks[i], focalLength);
-        } else {
-            projectCylindrical(temp, src[i], focalLength);
-            projectCylindrical(mask, blendMasks[i], focalLength);
-        }
+}
 
+
+// Back to the unregistered state of a new stitcher, keeping what can be reused
+// -----------------------------------------------------------------------------
+void RadialStitcher::reset(){
+
+    transforms.clear();
+    calibrated = false;
+    pairInliers.clear();
+    seams.clear();
+    for (int e = 0; e < 2; e++) {
+        eyes[e].windows.clear();
+        eyes[e].seams.clear();
     }
 
-}
+    previousFrames.clear();
+    cellSources.clear();
+    persistentCanvas.release();
+    framesSinceRefresh = 0;
+    tracking = false;
 
+    gains.assign(numImages, cv::Vec3d(1, 1, 1));
+    for (int i = 0; i < numImages; i++) gainTables[i].release();
+    framesSinceGains = 0;
 
-RadialStitcher::~RadialStitcher(){}
+}
 
 
-// Projects an image onto a cylindrical surface with specified focal length
+// Makes buffer size x type, reusing its memory when it already is. Every
+// stitcher-owned per frame buffer goes through here so allocations can be counted
 // -----------------------------------------------------------------------------
-int RadialStitcher::projectCylindrical(cv::Mat &I, cv::Mat&O, double f){
+void RadialStitcher::reserveBuffer(cv::Mat& buffer, cv::Size size, int type){
 
-    int nRows = I.rows;
-    int nCols = I.cols;
+    if(buffer.data && buffer.size() == size && buffer.type() == type) return;
 
-    int xCenter = nCols / 2;
-    int yCenter = nRows / 2;
-
-    int x, y;
-    uchar *sI;
-    uchar *sO;
-
-    // For every pixel in cylindrical projection
-    for (y = 0; y < nRows; y++) {
-        for (x = 0; x < nCols; x++) {
-
-            double theta = (x - xCenter) / f;
-            double h = (y - yCenter) / f;
-            double xp = sin(theta);
-            double yp = h;
-            double zp = cos(theta);
-
-            // Get pixel from input image
-            int xIn = round(f * xp / zp + xCenter);
-            int yIn = round(f * yp / zp + yCenter);
-
-            // In bounds?
-            sO = O.ptr<uchar>(y);
-            if(xIn > -1 && xIn < nCols && yIn > -1 && yIn < nRows){
-                sI = I.ptr<uchar>(yIn);
-                // 3 Channel BGR
-                sO[3*x] = sI[3*xIn]; // Blue
-                sO[3*x + 1] = sI[3*xIn + 1]; // Green
-                sO[3*x + 2] = sI[3*xIn + 2]; // Red
-            }
-        }
-    }
+    buffer.create(size, type);
+    allocations++;
+    allocatedBytes += (int64) (buffer.total() * buffer.elemSize());
 
-    return 0;
 }
 
 
-// Projects an image onto a spherical surface, returns warped image
+// Reads numImages files, left to right, as the next frame set
 // -----------------------------------------------------------------------------
-int RadialStitcher::projectSpherical(cv::Mat &I, cv::Mat&O, double f){
+int RadialStitcher::readImages(const char * const * fileNames){
 
-    int nRows = I.rows;
-    int nCols = I.cols;
+    // Decode in parallel into the last set's buffers, reduced in the decoder
+    Profiler::Mark start = profiler.mark();
+    int status = ImageReader(settings.decodeScale).read(numImages, fileNames, decoded);
+    profiler.stage("load", start, -1, "images", numImages);
 
-    int xCenter = nCols / 2;
-    int yCenter = nRows / 2;
-
-    int x, y;
-    uchar *sI;
-    uchar *sO;
-
-    // Inverse spherical projection
-    // For every pixel in spherical projection
-    // TODO can probably optimize this
-    for (y = 0; y < nRows; y++) {
-        for (x = 0; x < nCols; x++) {
-
-            double theta = (x - xCenter) / f;
-            double phi = (y - yCenter) / f;
-            double xp = sin(theta) * cos(phi);
-            double yp = sin(phi);
-            double zp = cos(theta) * cos(phi);
-
-            // Get pixel from input image
-            int xIn = round(f * xp / zp + xCenter);
-            int yIn = round(f * yp / zp + yCenter);
-
-            // In bounds?
-            sO = O.ptr<uchar>(y);
-            if(xIn > -1 && xIn < nCols && yIn > -1 && yIn < nRows){
-                sI = I.ptr<uchar>(yIn);
-                // 3 Channel RGB
-                sO[3*x] = sI[3*xIn]; // Blue
-                sO[3*x + 1] = sI[3*xIn + 1]; // Green
-                sO[3*x + 2] = sI[3*xIn + 2]; // Red
-            }
-        }
+    if(status){
+        std::cout << "Images could not be read." << std::endl;
+        return -1;
     }
 
-    return 0;
+    return setImages(decoded);
 
 }
 
 
-// Projects a mask onto a spherical surface, returns warped mask
+// Takes a new set of frames, one per camera, in left to right order. They are
+// only prewarped once registration or compose needs them, so a banded compose
+// never projects them whole. Once registered, frames are projected straight
+// to output scale
 // -----------------------------------------------------------------------------
-int RadialStitcher::projectMaskSpherical(cv::Mat &I, cv::Mat&O, double f){
+int RadialStitcher::setImages(std::vector<cv::Mat>& images){
 
-    int nRows = I.rows;
-    int nCols = I.cols;
+    if((int) images.size() != numImages) return -1;
 
-    int xCenter = nCols / 2;
-    int yCenter = nRows / 2;
-
-    int x, y;
-    double *sI;
-    double *sO;
-
-    // Inverse spherical projection
-    // For every pixel in spherical projection
-    for (y = 0; y < nRows; y++) {
-        for (x = 0; x < nCols; x++) {
-
-            double theta = (x - xCenter) / f;
-            double phi = (y - yCenter) / f;
-            double xp = sin(theta) * cos(phi);
-            double yp = sin(phi);
-            double zp = cos(theta) * cos(phi);
-
-            // Get pixel from input image
-            int xIn = round(f * xp / zp + xCenter);
-            int yIn = round(f * yp / zp + yCenter);
-
-            // In bounds?
-            sO = O.ptr<double>(y);
-            if(xIn > -1 && xIn < nCols && yIn > -1 && yIn < nRows){
-                sI = I.ptr<double>(yIn);
-                sO[x] = sI[xIn];
-            }
+    for (int i = 0; i < numImages; i++) {
+
+        if(!images[i].data) return -1;
+
+        if(calibrated && images[i].size() != imageSize){ // Transforms would not line up
+            std::cout << "Frame size does not match calibration." << std::endl;
+            return -1;
         }
+
     }
 
-    return 0;
+    // Between refreshes of incremental video only changes are looked for,
+    // compose reprojects just the cells they touch
+    bool track = canTrack(images);
+
+    // Kept by reference so registration and output can reproject them
+    for (int i = 0; i < numImages; i++) frames[i] = images[i];
+
+    int status = track ? trackChanges() : 0;
+    previousFrames = frames;
+    srcStale = true;
+    if(status) return -1;
+
+    if(track){
+        tracking = true;
+        framesSinceRefresh++;
+        return 0;
+    }
+
+    framesSinceRefresh = 0;
+    return updateGains();
 
 }
 
 
-// Makes an alpha/feathering mask for a given image
-// Pixels in center of image have alpha value 1 and linearly decreases to 0
-// towards edges of image
+// Prewarps frames handed in as raw BGR buffers, e.g. straight from a capture
+// SDK. Nothing is copied, buffers are only read and must stay valid until
+// the next setImages since registration may reproject them
 // -----------------------------------------------------------------------------
-int RadialStitcher::buildBlendMask(cv::Mat& img, cv::Mat& mask){
+int RadialStitcher::setImages(const std::vector<const uchar*>& data, cv::Size size, size_t step){
 
-    if(img.size() != mask.size()) return -1; // Check same size
+    if((int) data.size() != numImages) return -1;
 
-    int nRows = mask.rows;
-    int nCols = mask.cols;
-    int maxDist = 0;
+    std::vector<cv::Mat> images(numImages);
+    for (int i = 0; i < numImages; i++) {
+        if(!data[i]) return -1;
+        images[i] = cv::Mat(size, CV_8UC3, const_cast<uchar*>(data[i]), step);
+    }
 
-    if(nRows > nCols) maxDist = nCols / 2;
-    else maxDist = nRows / 2;
+    return setImages(images);
 
-    mask = cv::Scalar(0, 0, 0); // No alpha yet
+}
 
-    double* row;
 
-    int distLeft, distRight, distTop, distBottom; // Distances from edge of image
+// Projects the current frame set at a scale, 1 for registration and the
+// output scale once transforms are known
+// -----------------------------------------------------------------------------
+int RadialStitcher::prewarpFrames(double scale){
 
-    // Compute alpha intensity for each pixel in mask
-    for (int y = 0; y < nRows; y++) {
-        row = mask.ptr<double>(y);
-        distTop = abs(y + 1);
-        distBottom = abs(nRows - y - 1);
-        int yDist = std::min(distTop, distBottom);
-        for (int x = 0; x < nCols; x++) {
-            distLeft = abs(x + 1);
-            distRight = abs(nCols - x - 1);
-            int xDist = std::min(distLeft, distRight);
-            row[x] = (double) std::min(xDist, yDist) / (double) maxDist; // alpha
+    for (int i = 0; i < numImages; i++) {
+
+        if(!frames[i].data) return -1;
+
+        // Warp maps are shared between images, build them before going parallel
+        if(settings.useWarpMaps || scale != 1.0){
+            getWarpMap(frames[i].size(), settings.focalLength, settings.projection, scale);
         }
+
+    }
+
+    // Projections in parallel across images, row bands within each as well
+    Profiler::Mark start = profiler.mark();
+    parallelFor(numImages, [&](int i){ prewarpStatus[i] = prewarpImage(i, frames[i], scale); });
+    profiler.stage("project", start, -1, "scale", scale);
+
+    for (int i = 0; i < numImages; i++) {
+        if(prewarpStatus[i]) return -1;
     }
 
+    srcScale = scale;
+    tracking = false;
+    srcStale = false;
+
     return 0;
 
 }
 
 
-// Get feature points for two adjacent images and determines matching pairs
-// Uses ORB descriptor under the hood from OpenCV
+// Prewarps the current frames if they haven't been at the current scale
 // -----------------------------------------------------------------------------
-int RadialStitcher::getFeatures(cv::Mat& img1, cv::Mat& img2){
+int RadialStitcher::prewarp(){
 
-    // Feature Descriptor Parameters///////////////
-    int numFeatures = 2000;
-    float scaleFactor = 2.0;
-    int numLevels = 8;
-    int edgeThreshold = 31;
-    int firstLevel = 0;
-    int WTA_K = 2;
-    int scoreType = cv::ORB::HARRIS_SCORE;
-    int patchSize = 31;
-    int fastThreshold = 20;
-    ///////////////////////////////////////////////
+    double scale = prewarpScale();
+    if(srcScale == scale && !srcStale) return 0;
 
-    cv::Ptr<cv::ORB> detector = cv::ORB::create(
-        numFeatures,
-        scaleFactor,
-        numLevels,
-        edgeThreshold,
-        firstLevel,
-        WTA_K,
-        scoreType,
-        patchSize,
-        fastThreshold);
+    return prewarpFrames(scale);
+
+}
 
-    // Clear previous feature information from different image pair
-    keypoints1.clear();
-    keypoints2.clear();
-    matches.clear();
-    cv::Mat descriptors1; // curr's
-    cv::Mat descriptors2; // neighbor's
 
-    detector->detectAndCompute(img1, cv::Mat(), keypoints1, descriptors1);
-    detector->detectAndCompute(img2, cv::Mat(), keypoints2, descriptors2);
+// Projects one frame into src[i], and its blend mask if frame size changed
+// Resampling only goes through warp maps, they are what folds the scale in
+// -----------------------------------------------------------------------------
+int RadialStitcher::prewarpImage(int i, cv::Mat& temp, double scale){
 
+    cv::Size size = scaledSize(temp.size(), scale);
 
-    // Determine matching pairs via Euclidean distance in feature space
-    cv::BFMatcher matcher(cv::NORM_L2);
-    std::vector<cv::DMatch> approxMatches;
-    matcher.match(descriptors1, descriptors2, approxMatches);
+    bool newGeometry = blendMasks[i].size() != size || scale != srcScale;
 
-    // Find minimum keypoint error
-    double minDist = 100;
-    for(int i = 0; i < descriptors1.rows; i++){
-        double dist = approxMatches[i].distance;
-        if(dist < minDist) minDist = dist;
+    cv::Mat mask;
+    if(newGeometry){
+        if(buildBlendMask(temp, mask)) return -1;
+        reserveBuffer(blendMasks[i], size, mask.type());
+        blendMasks[i].setTo(cv::Scalar::all(0));
     }
 
-    // Keep only "good" matches i.e. those that are less than 3 * minDist
-    for(int i = 0; i < descriptors1.rows; i++){
-        if(approxMatches[i].distance < 3 * minDist) matches.push_back(approxMatches[i]);
+    // Remap writes every pixel, per-pixel projections skip unmapped ones
+    bool useMap = settings.useWarpMaps || scale != 1.0;
+    reserveBuffer(src[i], size, temp.type());
+    if(!useMap) src[i].setTo(cv::Scalar::all(0));
+
+    // Project image and its blend mask
+    double f = settings.focalLength;
+    bool gain = gainsActive() && temp.type() == CV_8UC3;
+    if(useMap){
+        cv::Ptr<const WarpMap> map = getWarpMap(temp.size(), f, settings.projection, scale);
+        if(gain && projectWithGain(temp, src[i], *map, gainTables[i])) return -1;
+        if(!gain && projectWithMap(temp, src[i], *map)) return -1;
+        if(newGeometry && projectWithMap(mask, blendMasks[i], *map)) return -1;
+        return 0;
     }
 
-    /*
-    cv::Mat img_matches;
-    drawMatches(img1, keypoints1, img2, keypoints2,
-        matches, img_matches, cv::Scalar::all(-1), cv::Scalar::all(-1),
-        std::vector<char>(), cv::DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS );
+    if(project(temp, src[i], f, settings.projection, settings.bilinear)) return -1;
+    if(newGeometry && project(mask, blendMasks[i], f, settings.projection, settings.bilinear)) return -1;
 
-    //imwrite("match.jpg", img_matches);
-    cv::imshow("Matches", img_matches);
-    cv::waitKey(0);
-    */
+    if(gain) cv::LUT(src[i], gainTables[i], src[i]); // Per-pixel paths have no gather to fold into
 
     return 0;
 
 }
 
 
-// Compute translation homography between 2 adjacent images
+RadialStitcher::~RadialStitcher(){}
+
+
+// Inverse projection models. Going from a projected pixel back to the flat
+// frame, x = f tan(theta) only depends on the column and y is a per row term
+// stretched by 1 / cos(theta), so the trig runs once per column and once per
+// row instead of once per pixel. Models differ in that row term only
 // -----------------------------------------------------------------------------
-int RadialStitcher::estimateHomography(cv::Mat& homography){
+struct CylindricalModel {
+    static double rowTerm(double dy, double f){ return dy; } // Height on the cylinder
+};
 
-    int nMatches = (int) matches.size();
+struct SphericalModel {
+    static double rowTerm(double dy, double f){ return f * tan(dy / f); } // Latitude phi = dy / f
+};
 
-    std::cout << nMatches << " feature point matches" << std::endl;
 
-    //int trials = 500;
-    int trials = nMatches;
-    double xTrans = 0;
-    double yTrans = 0;
-    double tolerance = 3.0; // pixels
-    int xQual = 0, yQual = 0; // 0 for bad, 1 for good, within tolerance
-    int concensus = 0;
-    int maxConcensus = 0;
-    int bestX = 0;
-    int bestY = 0;
+// Separable terms of the inverse projection for an nCols x nRows output grid
+// whose pixels are step projected pixels apart. Source coordinates are
+// x = columnX[x] and y = rowY[y] * stretch[x] + yCenter
+// -----------------------------------------------------------------------------
+template <typename Model>
+static void inverseTerms(cv::Size size, double f, double step, int nCols, int nRows,
+    std::vector<double>& columnX, std::vector<double>& stretch, std::vector<double>& rowY){
+
+    int xCenter = size.width / 2;
+    int yCenter = size.height / 2;
+
+    columnX.resize(nCols);
+    stretch.resize(nCols);
+    for (int x = 0; x < nCols; x++) {
+        double theta = (x * step - xCenter) / f;
+        columnX[x] = f * tan(theta) + xCenter;
+        stretch[x] = 1.0 / cos(theta);
+    }
 
-    srand(0);
+    rowY.resize(nRows);
+    for (int y = 0; y < nRows; y++) rowY[y] = Model::rowTerm(y * step - yCenter, f);
 
-    // RANSAC
+}
 
-    if(nMatches < trials) std::cout << "Less matches than trials" << std::endl;
 
-    // Estimate quality is high at around 500 iterations
-    for (int i = 0; i < trials; i++) {
+static void inverseTerms(RadialStitcher::Projection p, cv::Size size, double f, double step, int nCols, int nRows,
+    std::vector<double>& columnX, std::vector<double>& stretch, std::vector<double>& rowY){
 
-        // Inititialize
-        xQual = 0;
-        yQual = 0;
-        concensus = 0;
+    if(p == RadialStitcher::SPHERICAL) inverseTerms<SphericalModel>(size, f, step, nCols, nRows, columnX, stretch, rowY);
+    else inverseTerms<CylindricalModel>(size, f, step, nCols, nRows, columnX, stretch, rowY);
 
-        int featureNumber = rand() % nMatches; // Choose random feature pair
-        //std::cout << "ftNumb " << featureNumber << std::endl;
+}
 
-        // Use as reference
-        double xReferenceNew = keypoints1[matches[featureNumber].queryIdx].pt.x;
-        double xReferenceCur = keypoints2[matches[featureNumber].trainIdx].pt.x;
-        double yReferenceNew = keypoints1[matches[featureNumber].queryIdx].pt.y;
-        double yReferenceCur = keypoints2[matches[featureNumber].trainIdx].pt.y;
 
-        // Shift estimate
-        xTrans = xReferenceCur - xReferenceNew;
-        yTrans = yReferenceCur - yReferenceNew;
-        //std::cout << "xTrans " << xTrans << std::endl;
-        //std::cout << "yTrans " << yTrans << std::endl;
+// Projection kernel for one pixel type and channel count, O is I sized.
+// Nearest sampling rounds like the original per-pixel projections, bilinear
+// blends the four neighbors. Pixels that map outside I are left untouched
+// -----------------------------------------------------------------------------
+template <typename T, int CN, bool Bilinear>
+static void projectPixels(const cv::Mat& I, cv::Mat& O, const std::vector<double>& columnX,
+    const std::vector<double>& stretch, const std::vector<double>& rowY){
 
-        // Check against all other features
-        for (int j = 0; j < nMatches; j++) {
+    int nRows = I.rows;
+    int nCols = I.cols;
+    double yCenter = nRows / 2;
 
-            if (j == featureNumber) continue; // Skip reference feature
+    parallelFor(O.rows, [&](int y){
 
-            // Estimate x translation
-            double xNew = keypoints1[matches[j].queryIdx].pt.x;
-            double xCur = keypoints2[matches[j].trainIdx].pt.x;
-            double xEstimate = xCur - xNew;
-            //std::cout << "xEstimate " << xEstimate << std::endl;
+        T* out = O.ptr<T>(y);
+        double v = rowY[y];
 
-            // Estimate y translation
-            double yNew = keypoints1[matches[j].queryIdx].pt.y;
-            double yCur = keypoints2[matches[j].trainIdx].pt.y;
-            double yEstimate = yCur - yNew;
-            //std::cout << "yEstimate " << yEstimate << std::endl;
+        for (int x = 0; x < O.cols; x++) {
 
-            // Check if estimate is good against ground truth
-            //std::cout << "diffX " << fabs(xTrans - xEstimate) << std::endl;
-            //std::cout << "diffY " << fabs(yTrans - yEstimate) << std::endl;
-            if(fabs(xTrans - xEstimate) < tolerance) xQual = 1;
-            if(fabs(yTrans - yEstimate) < tolerance) yQual = 1;
-            if(xQual && yQual) concensus++;
+            double xIn = columnX[x];
+            double yIn = v * stretch[x] + yCenter;
 
-        }
+            if(!Bilinear){
+                int xs = (int) round(xIn);
+                int ys = (int) round(yIn);
+                if(xs < 0 || xs >= nCols || ys < 0 || ys >= nRows) continue;
+                const T* in = I.ptr<T>(ys) + CN * xs;
+                for (int c = 0; c < CN; c++) out[CN*x + c] = in[c];
+                continue;
+            }
+
+            if(!(xIn >= 0 && yIn >= 0 && xIn <= nCols - 1 && yIn <= nRows - 1)) continue;
+
+            int x0 = (int) xIn;
+            int y0 = (int) yIn;
+            int x1 = std::min(x0 + 1, nCols - 1);
+            int y1 = std::min(y0 + 1, nRows - 1);
+            double ax = xIn - x0;
+            double ay = yIn - y0;
+
+            const T* top = I.ptr<T>(y0);
+            const T* bottom = I.ptr<T>(y1);
+            for (int c = 0; c < CN; c++) {
+                double t = top[CN*x0 + c] + (top[CN*x1 + c] - (double) top[CN*x0 + c]) * ax;
+                double b = bottom[CN*x0 + c] + (bottom[CN*x1 + c] - (double) bottom[CN*x0 + c]) * ax;
+                out[CN*x + c] = cv::saturate_cast<T>(t + (b - t) * ay);
+            }
 
-        if(concensus > maxConcensus){
-            //std::cout << "ever?" << std::endl;
-            maxConcensus = concensus;
-            bestX = xTrans;
-            bestY = yTrans;
         }
 
+    });
+
+}
+
+
+// Picks the kernel instance for I's channel count, then its depth
+// -----------------------------------------------------------------------------
+template <typename T, bool Bilinear>
+static int projectChannels(const cv::Mat& I, cv::Mat& O, const std::vector<double>& columnX,
+    const std::vector<double>& stretch, const std::vector<double>& rowY){
+
+    switch (I.channels()) {
+        case 1: projectPixels<T, 1, Bilinear>(I, O, columnX, stretch, rowY); break;
+        case 2: projectPixels<T, 2, Bilinear>(I, O, columnX, stretch, rowY); break;
+        case 3: projectPixels<T, 3, Bilinear>(I, O, columnX, stretch, rowY); break;
+        case 4: projectPixels<T, 4, Bilinear>(I, O, columnX, stretch, rowY); break;
+        default: return -1;
     }
 
-    /*
-    // Averaging translation
-    //matches = 1; // temp override for testing, delete this later
-    for (int i = 0; i < nMatches; i++) {
+    return 0;
+
+}
 
-        double xNew = kpNew[matches[i].queryIdx].pt.x;
-        double xCur = kpCur[matches[i].trainIdx].pt.x;
-        xTrans += xCur - xNew;
 
-        double yNew = kpNew[matches[i].queryIdx].pt.y;
-        double yCur = kpCur[matches[i].trainIdx].pt.y;
-        yTrans += yCur - yNew;
+template <bool Bilinear>
+static int projectDepth(const cv::Mat& I, cv::Mat& O, const std::vector<double>& columnX,
+    const std::vector<double>& stretch, const std::vector<double>& rowY){
 
+    switch (I.depth()) {
+        case CV_8U: return projectChannels<uchar, Bilinear>(I, O, columnX, stretch, rowY);
+        case CV_16U: return projectChannels<ushort, Bilinear>(I, O, columnX, stretch, rowY);
+        case CV_32F: return projectChannels<float, Bilinear>(I, O, columnX, stretch, rowY);
+        case CV_64F: return projectChannels<double, Bilinear>(I, O, columnX, stretch, rowY);
+        default: return -1;
     }
-    */
 
-    // If no good concensus, just pick the most recent reference
-    if (bestX == 0)
-        bestX = xTrans;
-    if (bestY == 0)
-        bestY = yTrans;
+}
 
-    homography.at<double>(0, 2) = bestX;
-    homography.at<double>(1, 2) = bestY;
-    //std::cout << bestX << std::endl;
-    //std::cout << bestY << std::endl;
 
-    return 0;
+// Projects an image or mask of any supported type onto the cylinder or
+// sphere of focal length f without a warp map. O must be I's size and type
+// and is only written where the projection lands inside I
+// -----------------------------------------------------------------------------
+int RadialStitcher::project(cv::Mat &I, cv::Mat&O, double f, Projection p, bool bilinear){
+
+    if(O.size() != I.size() || O.type() != I.type()) return -1;
+
+    std::vector<double> columnX, stretch, rowY;
+    inverseTerms(p, I.size(), f, 1.0, I.cols, I.rows, columnX, stretch, rowY);
+
+    if(bilinear) return projectDepth<true>(I, O, columnX, stretch, rowY);
+
+    return projectDepth<false>(I, O, columnX, stretch, rowY);
 
 }
 
 
-// Blend 2 images together, both should have same size/bounding box
-// Current implementation assumes only blending with left neighbor
+// Least recently used maps are evicted past capacity. A user holds its map by
+// pointer, so eviction never frees one another stitcher is still reading
 // -----------------------------------------------------------------------------
-int RadialStitcher::blend(cv::Mat& newImage, cv::Mat& canvas, cv::Mat& newMask, cv::Mat& canvasMask){
+struct RadialStitcher::WarpCache {
+    struct Entry {
+        cv::Ptr<WarpMap> map;
+        int64 lastUse;
+    };
+    static const size_t capacity = 8; // Maps, a set uses about 2, one per scale
+    std::mutex mutex;
+    std::map<WarpKey, Entry> maps;
+    int64 uses;
+    WarpCache() : uses(0) {}
+};
+
+const size_t RadialStitcher::WarpCache::capacity;
+
+
+// Orders warp map keys for lookup in the cache
+// -----------------------------------------------------------------------------
+bool RadialStitcher::WarpKey::operator<(const WarpKey& other) const{
 
-    /*
-    imshow("newImage", newImage);
-    waitKey(0);
-    imshow("pano", canvas);
-    waitKey(0);
-    imshow("newMask", newMask);
-    waitKey(0);
-    imshow("canvasMask", canvasMask);
-    waitKey(0);
-    */
+    if(cols != other.cols) return cols < other.cols;
+    if(rows != other.rows) return rows < other.rows;
+    if(focalLength != other.focalLength) return focalLength < other.focalLength;
+    if(scale != other.scale) return scale < other.scale;
+    if(bilinear != other.bilinear) return bilinear < other.bilinear;
+    return projection < other.projection;
 
-    if(newImage.size() != canvas.size()) return -1; // Check same size
+}
 
-    int nRows = canvas.rows;
-    int nCols = canvas.cols;
 
-    uchar* rowCan; // Row in canvas/output panorama to update
-    uchar* rowNew; // Row in new image to blend in
-    double* alphaCan; // Alpha value of canvas/panorama
-    double* alphaNew; // Alpha value of new image
+// Returns the cached warp map for an image geometry, building it on first use.
+// A map that fails to build is handed out empty but not kept
+// -----------------------------------------------------------------------------
+cv::Ptr<const RadialStitcher::WarpMap> RadialStitcher::getWarpMap(cv::Size size, double f, Projection p, double scale){
+
+    WarpKey key;
+    key.cols = size.width;
+    key.rows = size.height;
+    key.focalLength = f;
+    key.scale = scale;
+    key.projection = p;
+    key.bilinear = settings.bilinear || scale != 1.0;
+
+    std::lock_guard<std::mutex> lock(warpCache->mutex);
+    int64 use = ++warpCache->uses;
+
+    std::map<WarpKey, WarpCache::Entry>::iterator it = warpCache->maps.find(key);
+    if(it != warpCache->maps.end()){
+        it->second.lastUse = use;
+        return it->second.map;
+    }
 
-    for (int y = 0; y < nRows; y++) {
-        rowCan = canvas.ptr<uchar>(y);
-        rowNew = newImage.ptr<uchar>(y);
-        alphaCan = canvasMask.ptr<double>(y);
-        alphaNew = newMask.ptr<double>(y);
+    cv::Ptr<WarpMap> map = cv::makePtr<WarpMap>();
+    if(buildWarpMap(size, f, p, scale, key.bilinear, *map)) return map; // Sizes never match it
+
+    while (warpCache->maps.size() >= WarpCache::capacity) {
+        std::map<WarpKey, WarpCache::Entry>::iterator oldest = warpCache->maps.begin();
+        for (it = warpCache->maps.begin(); it != warpCache->maps.end(); ++it) {
+            if(it->second.lastUse < oldest->second.lastUse) oldest = it;
+        }
+        warpCache->maps.erase(oldest);
+    }
+
+    WarpCache::Entry& entry = warpCache->maps[key];
+    entry.map = map;
+    entry.lastUse = use;
+    return map;
+
+}
+
+
+// Current prewarp map for a frame size as separate float x and y tables, the
+// layout GPU remap wants. Fixed-point maps convert back exactly
+// -----------------------------------------------------------------------------
+int RadialStitcher::getWarpMapFloat(cv::Size size, cv::Mat& mapX, cv::Mat& mapY, int& interpolation){
+
+    cv::Ptr<const WarpMap> map = getWarpMap(size, settings.focalLength, settings.projection, prewarpScale());
+    if(map->map1.empty()) return -1;
+
+    if(map->map1.type() == CV_32FC1){
+        mapX = map->map1;
+        mapY = map->map2;
+    } else {
+        cv::convertMaps(map->map1, map->map2, mapX, mapY, CV_32FC1);
+    }
+    interpolation = map->interpolation;
+
+    return 0;
+
+}
+
+
+// Computes the inverse projection once for every output pixel
+// Same separable math as project, stored as int16 fixed-point coordinates
+// when they fit, float maps otherwise. With scale != 1 the map also resamples
+// to the output resolution, so no separate resize pass is needed
+// -----------------------------------------------------------------------------
+int RadialStitcher::buildWarpMap(cv::Size size, double f, Projection p, double scale, bool bilinear, WarpMap& map){
+
+    // Output grid, every output pixel is 1 / scale projected pixels apart
+    bool resample = scale != 1.0;
+    int nRows = resample ? cvRound(size.height * scale) : size.height;
+    int nCols = resample ? cvRound(size.width * scale) : size.width;
+    if(nRows < 1 || nCols < 1) return -1;
+
+    std::vector<double> columnX, stretch, rowY;
+    inverseTerms(p, size, f, 1.0 / scale, nCols, nRows, columnX, stretch, rowY);
+    double yCenter = size.height / 2;
+
+    cv::Mat mapX(nRows, nCols, CV_32FC1);
+    cv::Mat mapY(nRows, nCols, CV_32FC1);
+
+    parallelFor(nRows, [&](int y){
+        float* rowX = mapX.ptr<float>(y);
+        float* rowYOut = mapY.ptr<float>(y);
+        double v = rowY[y];
         for (int x = 0; x < nCols; x++) {
-            if(rowCan[3*x] != 0 && rowNew[3*x] != 0){ // Feather region
-                double aN = alphaNew[x];
-                double aC = alphaCan[x];
-                rowCan[3*x] = (aN * rowNew[3*x] + aC * rowCan[3*x]) / (aN + aC); // Blue
-                rowCan[3*x + 1] = (aN * rowNew[3*x + 1] + aC * rowCan[3*x + 1]) / (aN + aC); // Green
-                rowCan[3*x + 2] = (aN * rowNew[3*x + 2] + aC * rowCan[3*x + 2]) / (aN + aC); // Red
-            } else if (!(rowCan[3*x] > 0)) {
-                rowCan[3*x] = rowNew[3*x];
-                rowCan[3*x + 1] = rowNew[3*x + 1];
-                rowCan[3*x + 2] = rowNew[3*x + 2];
-            }
+
+            // Nearest maps are rounded like project, out of range samples
+            // fall outside the image and come back black. Bilinear maps keep
+            // the fraction
+            double xIn = columnX[x];
+            double yIn = v * stretch[x] + yCenter;
+            rowX[x] = (float) (bilinear ? xIn : round(xIn));
+            rowYOut[x] = (float) (bilinear ? yIn : round(yIn));
         }
+    });
+
+    map.srcSize = size;
+    map.interpolation = bilinear ? cv::INTER_LINEAR : cv::INTER_NEAREST;
+
+    // Nearest-neighbor maps collapse to one CV_16SC2 matrix, 4 bytes per pixel,
+    // bilinear ones add a CV_16UC1 table of sub-pixel offsets
+    if(size.width < SHRT_MAX && size.height < SHRT_MAX){
+        cv::convertMaps(mapX, mapY, map.map1, map.map2, CV_16SC2, !bilinear);
+    } else {
+        map.map1 = mapX;
+        map.map2 = mapY;
     }
 
     return 0;
@@ -529,89 +696,2480 @@ int RadialStitcher::blend(cv::Mat& newImage, cv::Mat& canvas, cv::Mat& newMask,
 }
 
 
-// Main stitching process
-int RadialStitcher::Stitch(){
+// Projects an image or mask of any type through a precomputed warp map
+// -----------------------------------------------------------------------------
+int RadialStitcher::projectWithMap(cv::Mat &I, cv::Mat&O, const WarpMap& map){
 
-    std::cout << "Stitching " << numImages << " images..." << std::endl;
+    if(I.size() != map.srcSize) return -1; // Map built for another geometry
 
-    // Use first image to start panorama
-    cv::Mat first = src[0];
+    cv::remap(I, O, map.map1, map.map2, map.interpolation, cv::BORDER_CONSTANT, cv::Scalar());
 
-    // Output mosaic/canvas
-    cv::Mat out = cv::Mat::zeros(1.2 * first.rows, first.cols + ((numImages - 1) * 0.5 * first.cols), first.type());
+    return 0;
 
-    // 3x3 Identity
-    cv::Mat Id = (cv::Mat_<double>(3,3) <<
-        1, 0, 0,
-        0, 1, 0,
-        0, 0, 1);
+}
 
-    // Center first image
-    double xCenter = 0;
-    double yCenter = -first.rows/2 + out.rows/2;
 
-    cv::Mat Tr = (cv::Mat_<double>(3,3) << // Translation to center first image of panorama
-        1, 0, xCenter,
-        0, 1, yCenter,
-        0, 0, 1);
+// Projects a BGR frame through a warp map and applies its gain table in the
+// same gather, so exposure correction costs one table read per channel. O
+// must already be map sized. Bilinear maps keep cv::remap's interpolation and
+// apply the table afterward
+// -----------------------------------------------------------------------------
+int RadialStitcher::projectWithGain(cv::Mat &I, cv::Mat&O, const WarpMap& map, const cv::Mat& table){
 
-    transforms.push_back(Tr); // First homography for first input image
+    if(I.size() != map.srcSize || I.type() != CV_8UC3) return -1;
+    if(O.size() != map.map1.size() || O.type() != CV_8UC3) return -1;
 
-    // Warp in first image
-    warpPerspective(first, out, Tr, out.size());
+    if(map.interpolation != cv::INTER_NEAREST){
+        if(projectWithMap(I, O, map)) return -1;
+        cv::LUT(O, table, O);
+        return 0;
+    }
 
-    // Stitch remaining images in relative to first image
-    for (int i = 1; i < numImages; i++) {
+    const uchar* lut = table.ptr<uchar>(); // 256 B G R triples
+    bool fixedPoint = map.map1.type() == CV_16SC2;
 
-        cv::Mat curr = src[i]; // Current image to stitch in...
-        cv::Mat left = src[(i - 1) % numImages]; // ...And its left neighbor image
+    parallelFor(O.rows, [&](int y){
 
-        getFeatures(curr, left);
+        uchar* out = O.ptr<uchar>(y);
+        const short* xy = fixedPoint ? map.map1.ptr<short>(y) : 0;
+        const float* mapX = fixedPoint ? 0 : map.map1.ptr<float>(y);
+        const float* mapY = fixedPoint ? 0 : map.map2.ptr<float>(y);
 
-        cv::Mat H = (cv::Mat_<double>(3,3) << // Modify this to relate curr image to neighbor
-            1, 0, 0,
-            0, 1, 0,
-            0, 0, 1);
+        for (int x = 0; x < O.cols; x++, out += 3) {
 
-        estimateHomography(H); // Find translation
+            int sx = fixedPoint ? xy[2*x] : cvRound(mapX[x]);
+            int sy = fixedPoint ? xy[2*x + 1] : cvRound(mapY[x]);
 
-        cv::Mat warped = cv::Mat::zeros(out.rows, out.cols, out.type()); // Translated image
-        cv::Mat newMask = cv::Mat::zeros(out.rows, out.cols, CV_64F);
+            if(sx < 0 || sy < 0 || sx >= I.cols || sy >= I.rows){ // Same as BORDER_CONSTANT
+                out[0] = out[1] = out[2] = 0;
+                continue;
+            }
 
-        // Use this matrix to find the chain of transformations relating curr
-        // image to the first image
-        cv::Mat C = (cv::Mat_<double>(3,3) <<
-            1, 0, 0,
-            0, 1, 0,
-            0, 0, 1);
+            const uchar* in = I.ptr<uchar>(sy) + 3*sx;
+            out[0] = lut[3*in[0]];
+            out[1] = lut[3*in[1] + 1];
+            out[2] = lut[3*in[2] + 2];
 
-        // Stack all previous translations and...
-        C.at<double>(0, 2) += transforms[i - 1].at<double>(0, 2);
-        C.at<double>(1, 2) += transforms[i - 1].at<double>(1, 2);
+        }
 
-        //...add new homography for curr image
-        C.at<double>(0, 2) += H.at<double>(0, 2);
-        C.at<double>(1, 2) += H.at<double>(1, 2);
+    });
 
-        transforms.push_back(C);
-        warpPerspective(curr, warped, C, warped.size()); // Warp curr image
-        warpPerspective(blendMasks[i], newMask, C, newMask.size()); // And its mask
-        //std::cout << "here?" << std::endl;
+    return 0;
 
-        // Get its left neighbor's mask
-        cv::Mat prevMask = cv::Mat::zeros(out.rows, out.cols, CV_64F);
-        warpPerspective(blendMasks[i - 1], prevMask, transforms[i - 1], prevMask.size());
+}
 
-        // Blend and add to panorama
-        //out = 0.5 * warped + 0.5 * out; // Add to panorama
-        blend(warped, out, newMask, prevMask);
 
+// Makes an alpha/feathering mask for a given image
+// Pixels in center of image have alpha value 1 and linearly decreases to 0
+// towards edges of image. Alpha is the smaller of two 1D edge distance ramps so
+// each row is one vectorized min of the column ramp against the row's value
+// Mask is stored as settings.maskDepth, 1.0 maps to the top of the 8/16 bit range
+// -----------------------------------------------------------------------------
+int RadialStitcher::buildBlendMask(cv::Mat& img, cv::Mat& mask){
+
+    int nRows = img.rows;
+    int nCols = img.cols;
+    int maxDist = 0;
+
+    if(nRows > nCols) maxDist = nCols / 2;
+    else maxDist = nRows / 2;
+
+    if(maxDist < 1) return -1; // Image too small to feather
+
+    double alphaMax = 1.0;
+    if(settings.maskDepth == CV_8U) alphaMax = 255;
+    else if(settings.maskDepth == CV_16U) alphaMax = 65535;
+    double scale = alphaMax / maxDist;
+
+    // Distances from left/right edge of image, as alpha
+    cv::Mat rampX(1, nCols, CV_64F);
+    double* ramp = rampX.ptr<double>(0);
+    for (int x = 0; x < nCols; x++) {
+        int xDist = std::min(x + 1, nCols - x - 1);
+        ramp[x] = std::min(xDist * scale, alphaMax);
     }
+    cv::Mat columnAlpha;
+    rampX.convertTo(columnAlpha, settings.maskDepth);
 
-    cv::imwrite("panorama.jpg", out);
-    cv::imshow("panorama", out);
-    cv::waitKey(0);
+    mask.create(nRows, nCols, CV_MAKETYPE(settings.maskDepth, 1));
+
+    // Distance from top/bottom edge caps every row
+    for (int y = 0; y < nRows; y++) {
+        int yDist = std::min(y + 1, nRows - y - 1);
+        double rowAlpha = std::min(yDist * scale, alphaMax);
+        cv::Mat row = mask.row(y);
+        cv::min(columnAlpha, rowAlpha, row);
+    }
 
     return 0;
 
 }
+
+
+// Detects feature points of every image exactly once, images in parallel
+// -----------------------------------------------------------------------------
+int RadialStitcher::detectFeatures(){
+
+    features.resize(numImages);
+    parallelFor(numImages, [this](int i){
+        Profiler::Mark start = profiler.mark();
+        detectFeatures(i);
+        profiler.stage("detect", start, i, "keypoints", (double) features[i].keypoints.size());
+    });
+
+    return 0;
+
+}
+
+
+// Get feature points for one image
+// Uses ORB descriptor under the hood from OpenCV
+// -----------------------------------------------------------------------------
+int RadialStitcher::detectFeatures(int i){
+
+    // Feature Descriptor Parameters///////////////
+    int numFeatures = 2000;
+    float scaleFactor = 2.0;
+    int numLevels = 8;
+    int edgeThreshold = 31;
+    int firstLevel = 0;
+    int WTA_K = 2;
+    int scoreType = cv::ORB::HARRIS_SCORE;
+    int patchSize = 31;
+    int fastThreshold = 20;
+    ///////////////////////////////////////////////
+
+    // Coarse registration detects on a shrunk copy, fewer levels cover the
+    // same range of scales
+    cv::Mat image = src[i];
+    int shrink = std::max(1, settings.matchScale);
+    if(shrink > 1){
+        cv::Size size(std::max(1, src[i].cols / shrink), std::max(1, src[i].rows / shrink));
+        reserveBuffer(coarse[i], size, src[i].type());
+        cv::resize(src[i], coarse[i], size, 0, 0, cv::INTER_AREA);
+        image = coarse[i];
+        for (int s = shrink; s > 1 && numLevels > 1; s /= 2) numLevels--;
+    }
+
+    // One detector per image so images can be processed concurrently, kept
+    // between frame sets
+    if(detectors[i].empty()){
+        detectors[i] = cv::ORB::create(
+            numFeatures,
+            scaleFactor,
+            numLevels,
+            edgeThreshold,
+            firstLevel,
+            WTA_K,
+            scoreType,
+            patchSize,
+            fastThreshold);
+    }
+    cv::Ptr<cv::ORB>& detector = detectors[i];
+    detector->setMaxFeatures(numFeatures); // Overlap strips lower it below
+    detector->setNLevels(numLevels); // Match scale may have changed
+
+    // Clear previous feature information from a different frame set
+    features[i].keypoints.clear();
+    features[i].descriptors.release();
+    features[i].cols = image.cols;
+    features[i].scale = (double) image.cols / src[i].cols;
+
+    int nCols = image.cols;
+    int stripWidth = (int) ceil(settings.overlapFraction * nCols);
+
+    if(!settings.overlapOnly || 2 * stripWidth >= nCols){
+        detector->detectAndCompute(image, cv::Mat(), features[i].keypoints, features[i].descriptors);
+        return 0;
+    }
+
+    // Only the left strip can match image i - 1 and only the right strip can
+    // match image i + 1, a closed loop also pairs the ends. Strips are padded
+    // by the ORB border so keypoints at their inner edge still get descriptors
+    bool closed = closedLoop();
+    std::vector<cv::Rect> strips;
+    int padded = std::min(nCols, stripWidth + edgeThreshold);
+    if(i > 0 || closed) strips.push_back(cv::Rect(0, 0, padded, image.rows));
+    if(i < numImages - 1 || closed) strips.push_back(cv::Rect(nCols - padded, 0, padded, image.rows));
+
+    // Same feature density as a full frame detection
+    detector->setMaxFeatures(std::max(1, numFeatures * padded / nCols));
+
+    for (size_t s = 0; s < strips.size(); s++) {
+
+        std::vector<cv::KeyPoint> stripKeypoints;
+        cv::Mat stripDescriptors;
+        detector->detectAndCompute(image(strips[s]), cv::Mat(), stripKeypoints, stripDescriptors);
+
+        for (size_t k = 0; k < stripKeypoints.size(); k++) {
+            stripKeypoints[k].pt.x += strips[s].x; // Back to image coordinates
+            features[i].keypoints.push_back(stripKeypoints[k]);
+        }
+        features[i].descriptors.push_back(stripDescriptors);
+
+    }
+
+    return 0;
+
+}
+
+
+// Picks out descriptors of keypoints with x0 <= x < x1, index maps each picked
+// row back to its keypoint in features[i]
+// -----------------------------------------------------------------------------
+int RadialStitcher::selectStrip(int i, int x0, int x1, cv::Mat& descriptors, std::vector<int>& index){
+
+    Features& f = features[i];
+
+    index.clear();
+    for (int k = 0; k < (int) f.keypoints.size(); k++) {
+        float x = f.keypoints[k].pt.x;
+        if(x >= x0 && x < x1) index.push_back(k);
+    }
+
+    descriptors.create((int) index.size(), f.descriptors.cols, f.descriptors.type());
+    for (int k = 0; k < (int) index.size(); k++) {
+        f.descriptors.row(index[k]).copyTo(descriptors.row(k));
+    }
+
+    return 0;
+
+}
+
+
+// Determines matching feature pairs between two adjacent images from their
+// cached features
+// -----------------------------------------------------------------------------
+int RadialStitcher::matchFeatures(int curr, int left){
+
+    cv::Mat descriptors1 = features[curr].descriptors; // curr's
+    cv::Mat descriptors2 = features[left].descriptors; // neighbor's
+
+    matches.resize(numImages);
+    matches[curr].clear();
+
+    // Overlap mode, only curr's left strip can see left's right strip
+    std::vector<int> index1, index2;
+    if(settings.overlapOnly){
+        int stripWidth = (int) ceil(settings.overlapFraction * features[curr].cols);
+        int leftWidth = features[left].cols;
+        selectStrip(curr, 0, stripWidth, descriptors1, index1);
+        selectStrip(left, leftWidth - stripWidth, leftWidth, descriptors2, index2);
+    }
+
+    if(descriptors1.empty() || descriptors2.empty()) return -1; // Featureless image
+
+    // Determine matching pairs via Hamming distance in binary feature space
+    cv::Ptr<cv::DescriptorMatcher> matcher = createMatcher();
+    int64 deadline = matchBudget > 0 ? cv::getTickCount() + matchBudget : 0;
+
+    if(settings.matchFilter == RATIO_TEST){
+
+        // Keep matches clearly better than the runner up
+        std::vector<std::vector<cv::DMatch> > knn;
+        matchRows(*matcher, descriptors1, descriptors2, 2, deadline, knn);
+
+        for (size_t q = 0; q < knn.size(); q++) {
+            if(knn[q].empty()) continue;
+            if(knn[q].size() < 2 || knn[q][0].distance < settings.ratio * knn[q][1].distance){
+                matches[curr].push_back(knn[q][0]);
+            }
+        }
+
+    } else {
+
+        // Keep matches that are each other's best in both directions
+        std::vector<std::vector<cv::DMatch> > forward, backward;
+        matchRows(*matcher, descriptors1, descriptors2, 1, deadline, forward);
+        cv::Ptr<cv::DescriptorMatcher> reverse = createMatcher();
+        matchRows(*reverse, descriptors2, descriptors1, 1, deadline, backward);
+
+        for (size_t q = 0; q < forward.size(); q++) {
+            if(forward[q].empty()) continue;
+            int t = forward[q][0].trainIdx;
+            if(t < (int) backward.size() && !backward[t].empty() && backward[t][0].trainIdx == (int) q){
+                matches[curr].push_back(forward[q][0]);
+            }
+        }
+
+    }
+
+    // Strip rows back to keypoint indices
+    if(settings.overlapOnly){
+        for (size_t m = 0; m < matches[curr].size(); m++) {
+            matches[curr][m].queryIdx = index1[matches[curr][m].queryIdx];
+            matches[curr][m].trainIdx = index2[matches[curr][m].trainIdx];
+        }
+    }
+
+    /*
+    cv::Mat img_matches;
+    drawMatches(src[curr], features[curr].keypoints, src[left], features[left].keypoints,
+        matches[curr], img_matches, cv::Scalar::all(-1), cv::Scalar::all(-1),
+        std::vector<char>(), cv::DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS );
+
+    //imwrite("match.jpg", img_matches);
+    cv::imshow("Matches", img_matches);
+    cv::waitKey(0);
+    */
+
+    return 0;
+
+}
+
+
+// Creates the descriptor matcher selected in settings
+// -----------------------------------------------------------------------------
+cv::Ptr<cv::DescriptorMatcher> RadialStitcher::createMatcher(){
+
+    if(settings.matcher == LSH){
+        // Index pays off for large feature counts, hashes binary descriptors
+        return cv::makePtr<cv::FlannBasedMatcher>(cv::makePtr<cv::flann::LshIndexParams>(12, 20, 2));
+    }
+
+    // ORB with WTA_K = 2 gives one bit per test, compared with popcount
+    return cv::makePtr<cv::BFMatcher>(cv::NORM_HAMMING);
+
+}
+
+
+// k nearest neighbor search of query rows against train rows. Queries run in
+// chunks and stop once the deadline has passed, unmatched rows stay empty
+// -----------------------------------------------------------------------------
+int RadialStitcher::matchRows(cv::DescriptorMatcher& matcher, const cv::Mat& query, const cv::Mat& train,
+    int k, int64 deadline, std::vector<std::vector<cv::DMatch> >& knn){
+
+    const int chunkRows = 256;
+
+    knn.clear();
+    knn.resize(query.rows);
+
+    matcher.clear();
+    matcher.add(std::vector<cv::Mat>(1, train));
+    matcher.train(); // Builds index once for all chunks
+
+    for (int start = 0; start < query.rows; start += chunkRows) {
+
+        if(deadline && start > 0 && cv::getTickCount() > deadline) break; // Out of time
+
+        int end = std::min(query.rows, start + chunkRows);
+        std::vector<std::vector<cv::DMatch> > chunk;
+        matcher.knnMatch(query.rowRange(start, end), chunk, k);
+
+        for (size_t q = 0; q < chunk.size(); q++) {
+            for (size_t n = 0; n < chunk[q].size(); n++) chunk[q][n].queryIdx += start;
+            knn[start + q].swap(chunk[q]);
+        }
+
+    }
+
+    return 0;
+
+}
+
+
+// Compute translation homography between 2 adjacent images
+// -----------------------------------------------------------------------------
+int RadialStitcher::estimateHomography(int curr, int left, cv::Mat& homography){
+
+    std::vector<cv::DMatch>& matches = this->matches[curr];
+    std::vector<cv::KeyPoint>& keypoints1 = features[curr].keypoints; // curr image keypoints
+    std::vector<cv::KeyPoint>& keypoints2 = features[left].keypoints; // neighbor image keypoints
+
+    int nMatches = (int) matches.size();
+
+    pairInliers.resize(numImages);
+    pairInliers[curr] = 0;
+
+    if(nMatches == 0) return -1; // Nothing to vote with
+
+    // Every match votes for the shift taking curr onto its left neighbor
+    std::vector<cv::Point2d> shifts(nMatches);
+    for (int j = 0; j < nMatches; j++) {
+        const cv::Point2f& ptNew = keypoints1[matches[j].queryIdx].pt;
+        const cv::Point2f& ptCur = keypoints2[matches[j].trainIdx].pt;
+        shifts[j] = cv::Point2d(ptCur.x - ptNew.x, ptCur.y - ptNew.y);
+    }
+
+    double xTrans = 0;
+    double yTrans = 0;
+    int inliers = 0;
+
+    if(settings.estimator == RANSAC) inliers = ransacTranslation(shifts, xTrans, yTrans);
+    else inliers = voteTranslation(shifts, xTrans, yTrans);
+
+    pairInliers[curr] = inliers; // Reported with the estimate stage
+
+    if(inliers < settings.minInliers) return -1; // Too little agreement, bad pair
+
+    // Back to src pixels from the detection scale
+    homography.at<double>(0, 2) = xTrans / features[curr].scale;
+    homography.at<double>(1, 2) = yTrans / features[curr].scale;
+
+    return 0;
+
+}
+
+
+// Refines a coarse translation to sub-pixel accuracy at full resolution by
+// phase correlating a window of the overlap, taken from both images where
+// the estimate says they line up. Correlation wraps around the window, so
+// only corrections well inside it are trusted. Leaves homography as it is
+// when the overlap is too small or the peak is weak
+// -----------------------------------------------------------------------------
+int RadialStitcher::refineTranslation(int curr, int left, cv::Mat& homography){
+
+    const int maxWindow = 512; // pixels, per side
+    const int minWindow = 32;
+    const double minResponse = 0.05; // Of a perfect single peak
+
+    int tx = cvRound(homography.at<double>(0, 2));
+    int ty = cvRound(homography.at<double>(1, 2));
+
+    // Overlap in left's pixels, curr sits at (tx, ty) there
+    cv::Rect overlap = cv::Rect(0, 0, src[left].cols, src[left].rows) &
+        cv::Rect(tx, ty, src[curr].cols, src[curr].rows);
+
+    // Largest power of two window that fits, centered in the overlap
+    int side = maxWindow;
+    while (side > std::min(overlap.width, overlap.height)) side /= 2;
+    if(side < minWindow) return -1;
+
+    cv::Rect windowLeft(overlap.x + (overlap.width - side) / 2, overlap.y + (overlap.height - side) / 2, side, side);
+    cv::Rect windowCurr = windowLeft - cv::Point(tx, ty);
+
+    cv::Mat gray;
+    cv::cvtColor(src[left](windowLeft), gray, cv::COLOR_BGR2GRAY);
+    gray.convertTo(refineA, CV_32F);
+    cv::cvtColor(src[curr](windowCurr), gray, cv::COLOR_BGR2GRAY);
+    gray.convertTo(refineB, CV_32F);
+    if(refineWindow.size() != cv::Size(side, side)) cv::createHanningWindow(refineWindow, cv::Size(side, side), CV_32F);
+
+    // curr's window is left's shifted by the remaining error
+    double response = 0;
+    cv::Point2d error = cv::phaseCorrelate(refineB, refineA, refineWindow, &response);
+
+    double limit = std::max(4, 2 * std::max(1, settings.matchScale));
+    if(response < minResponse || fabs(error.x) > limit || fabs(error.y) > limit) return -1;
+
+    homography.at<double>(0, 2) = tx + error.x;
+    homography.at<double>(1, 2) = ty + error.y;
+
+    return 0;
+
+}
+
+
+// Linear time translation estimate. Shifts are binned into a sparse 2D
+// histogram, the densest 3x3 neighborhood of bins wins and the estimate is
+// refined with a least-squares mean over matches within tolerance
+// Returns number of inliers
+// -----------------------------------------------------------------------------
+int RadialStitcher::voteTranslation(const std::vector<cv::Point2d>& shifts, double& xTrans, double& yTrans){
+
+    const double tolerance = 3.0; // pixels, also used as bin size
+    int nShifts = (int) shifts.size();
+
+    // Bin index packed into one key, shifts are bounded by image size
+    const long long binStride = 1LL << 32;
+    std::unordered_map<long long, int> histogram;
+    histogram.reserve(nShifts);
+
+    std::vector<long long> binX(nShifts), binY(nShifts);
+    for (int j = 0; j < nShifts; j++) {
+        binX[j] = (long long) floor(shifts[j].x / tolerance);
+        binY[j] = (long long) floor(shifts[j].y / tolerance);
+        histogram[binX[j] * binStride + binY[j]]++;
+    }
+
+    // Peak of the histogram smoothed over neighbors, catches clusters that
+    // straddle a bin edge
+    long long peakX = binX[0], peakY = binY[0];
+    int peakVotes = 0;
+    for (int j = 0; j < nShifts; j++) {
+        int votes = 0;
+        for (long long dx = -1; dx <= 1; dx++) {
+            for (long long dy = -1; dy <= 1; dy++) {
+                std::unordered_map<long long, int>::iterator n =
+                    histogram.find((binX[j] + dx) * binStride + binY[j] + dy);
+                if(n != histogram.end()) votes += n->second;
+            }
+        }
+        if(votes > peakVotes){
+            peakVotes = votes;
+            peakX = binX[j];
+            peakY = binY[j];
+        }
+    }
+
+    // Start from the mean of the peak neighborhood...
+    double sumX = 0, sumY = 0;
+    int count = 0;
+    for (int j = 0; j < nShifts; j++) {
+        if(std::abs(binX[j] - peakX) <= 1 && std::abs(binY[j] - peakY) <= 1){
+            sumX += shifts[j].x;
+            sumY += shifts[j].y;
+            count++;
+        }
+    }
+    xTrans = sumX / count;
+    yTrans = sumY / count;
+
+    // ...then refine, least squares for a pure translation is the inlier mean
+    int inliers = count;
+    for (int iteration = 0; iteration < 2; iteration++) {
+        sumX = 0;
+        sumY = 0;
+        inliers = 0;
+        for (int j = 0; j < nShifts; j++) {
+            if(fabs(shifts[j].x - xTrans) < tolerance && fabs(shifts[j].y - yTrans) < tolerance){
+                sumX += shifts[j].x;
+                sumY += shifts[j].y;
+                inliers++;
+            }
+        }
+        if(inliers == 0) break;
+        xTrans = sumX / inliers;
+        yTrans = sumY / inliers;
+    }
+
+    return inliers;
+
+}
+
+
+// RANSAC translation estimate, one match per hypothesis. Stops early once the
+// chance of having missed a better hypothesis drops below 1 - confidence
+// Returns number of inliers
+// -----------------------------------------------------------------------------
+int RadialStitcher::ransacTranslation(const std::vector<cv::Point2d>& shifts, double& xTrans, double& yTrans){
+
+    int nMatches = (int) shifts.size();
+
+    int trials = nMatches;
+    double tolerance = 3.0; // pixels
+    int concensus = 0;
+    int maxConcensus = 0;
+    double bestX = 0;
+    double bestY = 0;
+
+    srand(0);
+
+    // RANSAC
+    for (int i = 0; i < trials; i++) {
+
+        concensus = 0;
+
+        int featureNumber = rand() % nMatches; // Choose random feature pair
+
+        // Use as reference, shift estimate
+        xTrans = shifts[featureNumber].x;
+        yTrans = shifts[featureNumber].y;
+
+        // Check against all other features
+        for (int j = 0; j < nMatches; j++) {
+
+            if (j == featureNumber) continue; // Skip reference feature
+
+            // Check if estimate is good against ground truth
+            int xQual = fabs(xTrans - shifts[j].x) < tolerance; // 0 for bad, 1 for good
+            int yQual = fabs(yTrans - shifts[j].y) < tolerance;
+            if(xQual && yQual) concensus++;
+
+        }
+
+        if(concensus > maxConcensus){
+
+            maxConcensus = concensus;
+            bestX = xTrans;
+            bestY = yTrans;
+
+            // Adaptive number of trials for the observed inlier ratio
+            double inlierRatio = (double) (maxConcensus + 1) / nMatches;
+            if(inlierRatio >= 1.0) break;
+            double needed = log(1.0 - settings.confidence) / log(1.0 - inlierRatio);
+            if(needed < trials) trials = std::max(i + 1, (int) ceil(needed));
+
+        }
+
+    }
+
+    // If no good concensus, just pick the most recent reference
+    if (maxConcensus == 0) return 1;
+
+    xTrans = bestX;
+    yTrans = bestY;
+
+    return maxConcensus + 1; // Reference agrees with itself
+
+}
+
+
+// A BGR pixel has content unless all three channels are 0, the black left
+// around projected images. Every blender and the CUDA backend use this rule
+// -----------------------------------------------------------------------------
+static inline bool hasContent(const uchar* p){
+
+    return (p[0] | p[1] | p[2]) != 0;
+
+}
+
+
+// Reference feather for masks of element type M, weights are a ratio so the
+// mask scale does not matter
+// -----------------------------------------------------------------------------
+template <typename M>
+static void blendRows(cv::Mat& newImage, cv::Mat& canvas, cv::Mat& newMask, cv::Mat& canvasMask){
+
+    int nRows = canvas.rows;
+    int nCols = canvas.cols;
+
+    uchar* rowCan; // Row in canvas/output panorama to update
+    uchar* rowNew; // Row in new image to blend in
+    M* alphaCan; // Alpha value of canvas/panorama
+    M* alphaNew; // Alpha value of new image
+
+    for (int y = 0; y < nRows; y++) {
+        rowCan = canvas.ptr<uchar>(y);
+        rowNew = newImage.ptr<uchar>(y);
+        alphaCan = canvasMask.ptr<M>(y);
+        alphaNew = newMask.ptr<M>(y);
+        for (int x = 0; x < nCols; x++) {
+            if(hasContent(rowCan + 3*x) && hasContent(rowNew + 3*x)){ // Feather region
+                double aN = alphaNew[x];
+                double aC = alphaCan[x];
+                rowCan[3*x] = (aN * rowNew[3*x] + aC * rowCan[3*x]) / (aN + aC); // Blue
+                rowCan[3*x + 1] = (aN * rowNew[3*x + 1] + aC * rowCan[3*x + 1]) / (aN + aC); // Green
+                rowCan[3*x + 2] = (aN * rowNew[3*x + 2] + aC * rowCan[3*x + 2]) / (aN + aC); // Red
+            } else if (!hasContent(rowCan + 3*x)) {
+                rowCan[3*x] = rowNew[3*x];
+                rowCan[3*x + 1] = rowNew[3*x + 1];
+                rowCan[3*x + 2] = rowNew[3*x + 2];
+            }
+        }
+    }
+
+}
+
+
+// Blend 2 images together, both should have same size/bounding box
+// Current implementation assumes only blending with left neighbor
+// -----------------------------------------------------------------------------
+int RadialStitcher::blend(cv::Mat& newImage, cv::Mat& canvas, cv::Mat& newMask, cv::Mat& canvasMask){
+
+    /*
+    imshow("newImage", newImage);
+    waitKey(0);
+    imshow("pano", canvas);
+    waitKey(0);
+    imshow("newMask", newMask);
+    waitKey(0);
+    imshow("canvasMask", canvasMask);
+    waitKey(0);
+    */
+
+    if(newImage.size() != canvas.size()) return -1; // Check same size
+
+    switch (newMask.depth()) {
+        case CV_8U: blendRows<uchar>(newImage, canvas, newMask, canvasMask); break;
+        case CV_16U: blendRows<ushort>(newImage, canvas, newMask, canvasMask); break;
+        case CV_64F: blendRows<double>(newImage, canvas, newMask, canvasMask); break;
+        default: return -1;
+    }
+
+    return 0;
+
+}
+
+
+// Per-pixel weight of the new image in 8.8 fixed point, repeated for each of
+// the 3 channels. Same rules as blend: feather where both images have content,
+// take the new pixel where canvas is empty, keep canvas where new is empty
+// -----------------------------------------------------------------------------
+template <typename M>
+static void featherWeights(const uchar* rowNew, const uchar* rowCan, const M* alphaNew,
+    const M* alphaCan, int nCols, ushort* weights){
+
+    for (int x = 0; x < nCols; x++) {
+        float aN = (float) alphaNew[x];
+        float aC = (float) alphaCan[x];
+        float sum = aN + aC;
+        int feather = sum > 0 ? (int) (256.0f * aN / sum + 0.5f) : 0;
+        int w = hasContent(rowCan + 3*x) ? (hasContent(rowNew + 3*x) ? feather : 0) : 256;
+        weights[3*x] = weights[3*x + 1] = weights[3*x + 2] = (ushort) w;
+    }
+
+}
+
+
+// Branch-free weighted average of n interleaved channel values,
+// out = (new * w + canvas * (256 - w) + 128) >> 8, fits in 16 bit lanes
+// -----------------------------------------------------------------------------
+static void featherRow(const uchar* rowNew, uchar* rowCan, const ushort* weights, int n){
+
+    int x = 0;
+
+#if defined(__AVX2__)
+    const __m256i full = _mm256_set1_epi16(256);
+    const __m256i half = _mm256_set1_epi16(128);
+    for (; x + 32 <= n; x += 32) {
+        __m256i w0 = _mm256_loadu_si256((const __m256i*) (weights + x));
+        __m256i w1 = _mm256_loadu_si256((const __m256i*) (weights + x + 16));
+        __m256i n0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (rowNew + x)));
+        __m256i n1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (rowNew + x + 16)));
+        __m256i c0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (rowCan + x)));
+        __m256i c1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (rowCan + x + 16)));
+        __m256i r0 = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(n0, w0),
+            _mm256_mullo_epi16(c0, _mm256_sub_epi16(full, w0))), half);
+        __m256i r1 = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(n1, w1),
+            _mm256_mullo_epi16(c1, _mm256_sub_epi16(full, w1))), half);
+        __m256i packed = _mm256_packus_epi16(_mm256_srli_epi16(r0, 8), _mm256_srli_epi16(r1, 8));
+        packed = _mm256_permute4x64_epi64(packed, 0xD8); // Undo per-lane packing order
+        _mm256_storeu_si256((__m256i*) (rowCan + x), packed);
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full8 = _mm_set1_epi16(256);
+    const __m128i half8 = _mm_set1_epi16(128);
+    for (; x + 16 <= n; x += 16) {
+        __m128i w0 = _mm_loadu_si128((const __m128i*) (weights + x));
+        __m128i w1 = _mm_loadu_si128((const __m128i*) (weights + x + 8));
+        __m128i vn = _mm_loadu_si128((const __m128i*) (rowNew + x));
+        __m128i vc = _mm_loadu_si128((const __m128i*) (rowCan + x));
+        __m128i r0 = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(vn, zero), w0),
+            _mm_mullo_epi16(_mm_unpacklo_epi8(vc, zero), _mm_sub_epi16(full8, w0))), half8);
+        __m128i r1 = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(vn, zero), w1),
+            _mm_mullo_epi16(_mm_unpackhi_epi8(vc, zero), _mm_sub_epi16(full8, w1))), half8);
+        _mm_storeu_si128((__m128i*) (rowCan + x), _mm_packus_epi16(_mm_srli_epi16(r0, 8), _mm_srli_epi16(r1, 8)));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint16x8_t full8 = vdupq_n_u16(256);
+    for (; x + 16 <= n; x += 16) {
+        uint16x8_t w0 = vld1q_u16(weights + x);
+        uint16x8_t w1 = vld1q_u16(weights + x + 8);
+        uint8x16_t vn = vld1q_u8(rowNew + x);
+        uint8x16_t vc = vld1q_u8(rowCan + x);
+        uint16x8_t r0 = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(vn)), w0), vmovl_u8(vget_low_u8(vc)), vsubq_u16(full8, w0));
+        uint16x8_t r1 = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(vn)), w1), vmovl_u8(vget_high_u8(vc)), vsubq_u16(full8, w1));
+        vst1q_u8(rowCan + x, vcombine_u8(vrshrn_n_u16(r0, 8), vrshrn_n_u16(r1, 8))); // Rounding shift adds the 128
+    }
+#endif
+
+    for (; x < n; x++) { // Tail
+        int w = weights[x];
+        rowCan[x] = (uchar) ((rowNew[x] * w + rowCan[x] * (256 - w) + 128) >> 8);
+    }
+
+}
+
+
+// Fixed-point feather of new image into canvas, both should have same size,
+// intended for the overlap rectangle only
+// -----------------------------------------------------------------------------
+int RadialStitcher::blendFeather(cv::Mat& newImage, cv::Mat& canvas, cv::Mat& newMask, cv::Mat& canvasMask){
+
+    if(newImage.size() != canvas.size()) return -1; // Check same size
+    if(newImage.type() != CV_8UC3 || newMask.type() != canvasMask.type()) return -1;
+
+    int nRows = canvas.rows;
+    int nCols = canvas.cols;
+
+    featherScratch.resize(3 * nCols); // Keeps its capacity across calls
+    ushort* weights = &featherScratch[0];
+
+    for (int y = 0; y < nRows; y++) {
+
+        const uchar* rowNew = newImage.ptr<uchar>(y);
+        uchar* rowCan = canvas.ptr<uchar>(y);
+
+        switch (newMask.depth()) {
+            case CV_8U:
+                featherWeights(rowNew, rowCan, newMask.ptr<uchar>(y), canvasMask.ptr<uchar>(y), nCols, weights);
+                break;
+            case CV_16U:
+                featherWeights(rowNew, rowCan, newMask.ptr<ushort>(y), canvasMask.ptr<ushort>(y), nCols, weights);
+                break;
+            case CV_64F:
+                featherWeights(rowNew, rowCan, newMask.ptr<double>(y), canvasMask.ptr<double>(y), nCols, weights);
+                break;
+            default:
+                return -1;
+        }
+
+        featherRow(rowNew, rowCan, weights, 3 * nCols);
+
+    }
+
+    return 0;
+
+}
+
+
+// Multi-band seam mask, 1 where the new image wins. Same content rules as
+// featherWeights, but a hard choice: the higher alpha takes the pixel and
+// the pyramid does the smoothing, wide for low frequencies and narrow for
+// detail, so exposure steps fade out without ghosting edges
+// -----------------------------------------------------------------------------
+template <typename M>
+static void seamMaskRow(const uchar* rowNew, const uchar* rowCan, const M* alphaNew,
+    const M* alphaCan, int nCols, float* mask){
+
+    for (int x = 0; x < nCols; x++) {
+        float wins = alphaNew[x] >= alphaCan[x] ? 1.0f : 0.0f;
+        mask[x] = hasContent(rowCan + 3*x) ? (hasContent(rowNew + 3*x) ? wins : 0.0f) : 1.0f;
+    }
+
+}
+
+
+// One pyramid level of the fused blend and collapse,
+// out = up + la + (lb - la) * m with la = a - upA and lb = b - upB the
+// Laplacian levels of both images. Top level passes empty ups
+// -----------------------------------------------------------------------------
+static void blendLevel(const cv::Mat& a, const cv::Mat& upA, const cv::Mat& b, const cv::Mat& upB,
+    const cv::Mat& m, const cv::Mat& up, cv::Mat& out){
+
+    bool top = up.empty();
+    int nCols = a.cols;
+
+    for (int y = 0; y < a.rows; y++) {
+
+        const float* rowA = a.ptr<float>(y);
+        const float* rowB = b.ptr<float>(y);
+        const float* rowM = m.ptr<float>(y);
+        const float* rowUpA = top ? 0 : upA.ptr<float>(y);
+        const float* rowUpB = top ? 0 : upB.ptr<float>(y);
+        const float* rowUp = top ? 0 : up.ptr<float>(y);
+        float* rowOut = out.ptr<float>(y);
+
+        for (int x = 0; x < nCols; x++) {
+            float w = rowM[x];
+            for (int c = 0; c < 3; c++) {
+                int k = 3*x + c;
+                float la = top ? rowA[k] : rowA[k] - rowUpA[k];
+                float lb = top ? rowB[k] : rowB[k] - rowUpB[k];
+                rowOut[k] = (top ? 0.0f : rowUp[k]) + la + (lb - la) * w;
+            }
+        }
+
+    }
+
+}
+
+
+// Laplacian pyramid blend of an overlap tile, same interface as blendFeather
+// The tile is processed in bands of settings.blendBandRows rows, each padded
+// by enough rows that the coarsest level sees the same neighborhood it would
+// in one full pyramid, so memory is bounded by the band and not the canvas.
+// Pyramids sit on a grid of coarsest pixels fixed to the canvas at origin, so
+// an overlap cut short by a banded or incremental compose region blends the
+// same as the whole one does
+// -----------------------------------------------------------------------------
+int RadialStitcher::blendMultiBand(cv::Mat& newImage, cv::Mat& canvas, cv::Mat& newMask, cv::Mat& canvasMask,
+    cv::Point origin){
+
+    if(newImage.size() != canvas.size()) return -1; // Check same size
+    if(newImage.type() != CV_8UC3 || newMask.type() != canvasMask.type()) return -1;
+
+    int nRows = canvas.rows;
+    int nCols = canvas.cols;
+
+    // Coarsest level keeps at least 2 pixels across
+    int levels = std::max(1, settings.blendLevels);
+    while (levels > 1 && (std::min(nCols, nRows) >> levels) < 2) levels--;
+
+    // Blur support grows about 4 pixels per level at that level's scale.
+    // Bands after the first start on the canvas grid, as margin is a whole
+    // number of cells, so every band's pyramid lands on the same grid. The
+    // first band and every band's left edge are padded out to it
+    int margin = 4 << levels;
+    int cell = 1 << levels;
+    int bandRows = std::max(settings.blendBandRows, margin);
+    bandRows = (bandRows + cell - 1) / cell * cell;
+    int phaseY = origin.y & (cell - 1);
+    int padLeft = origin.x & (cell - 1);
+
+    pyramidNew.resize(levels + 1);
+    pyramidCanvas.resize(levels + 1);
+    pyramidMask.resize(levels + 1);
+    pyramidUpNew.resize(levels);
+    pyramidUpCanvas.resize(levels);
+    pyramidUpOut.resize(levels);
+    pyramidOut.resize(levels + 1);
+
+    for (int y0 = 0, y1 = 0; y0 < nRows; y0 = y1) {
+
+        y1 = std::min(nRows, y0 + bandRows - ((phaseY + y0) & (cell - 1)));
+        int top = std::max(0, y0 - margin);
+        int bottom = std::min(nRows, y1 + margin);
+        int padTop = (phaseY + top) & (cell - 1); // Only the first band is off grid
+        cv::Rect padded(0, top, nCols, bottom - top);
+        bool onGrid = padTop == 0 && padLeft == 0;
+
+        // Canvas rows above y0 were already blended by the previous band,
+        // its original pixels were saved in bandCarry
+        reserveBuffer(bandCanvas, padded.size(), CV_8UC3);
+        canvas(padded).copyTo(bandCanvas);
+        if(y0 > top) bandCarry(cv::Rect(0, bandCarry.rows - (y0 - top), nCols, y0 - top))
+            .copyTo(bandCanvas(cv::Rect(0, 0, nCols, y0 - top)));
+
+        // Base level, built in place when the band already is on the grid
+        cv::Mat& maskBase = onGrid ? pyramidMask[0] : baseMask;
+        reserveBuffer(maskBase, padded.size(), CV_32FC1);
+        for (int y = 0; y < padded.height; y++) {
+            const uchar* rowNew = newImage.ptr<uchar>(top + y);
+            const uchar* rowCan = bandCanvas.ptr<uchar>(y);
+            float* rowMask = maskBase.ptr<float>(y);
+            switch (newMask.depth()) {
+                case CV_8U:
+                    seamMaskRow(rowNew, rowCan, newMask.ptr<uchar>(top + y), canvasMask.ptr<uchar>(top + y), nCols, rowMask);
+                    break;
+                case CV_16U:
+                    seamMaskRow(rowNew, rowCan, newMask.ptr<ushort>(top + y), canvasMask.ptr<ushort>(top + y), nCols, rowMask);
+                    break;
+                case CV_64F:
+                    seamMaskRow(rowNew, rowCan, newMask.ptr<double>(top + y), canvasMask.ptr<double>(top + y), nCols, rowMask);
+                    break;
+                default:
+                    return -1;
+            }
+        }
+        if(onGrid){
+            newImage(padded).convertTo(pyramidNew[0], CV_32FC3);
+            bandCanvas.convertTo(pyramidCanvas[0], CV_32FC3);
+        } else {
+            cv::Size size(nCols + padLeft, padded.height + padTop);
+            newImage(padded).convertTo(baseNew, CV_32FC3);
+            bandCanvas.convertTo(baseCanvas, CV_32FC3);
+            reserveBuffer(pyramidNew[0], size, CV_32FC3);
+            reserveBuffer(pyramidCanvas[0], size, CV_32FC3);
+            reserveBuffer(pyramidMask[0], size, CV_32FC1);
+            cv::copyMakeBorder(baseNew, pyramidNew[0], padTop, 0, padLeft, 0, cv::BORDER_REFLECT_101);
+            cv::copyMakeBorder(baseCanvas, pyramidCanvas[0], padTop, 0, padLeft, 0, cv::BORDER_REFLECT_101);
+            cv::copyMakeBorder(baseMask, pyramidMask[0], padTop, 0, padLeft, 0, cv::BORDER_REFLECT_101);
+        }
+
+        // Gaussian pyramids of both images and the seam mask
+        for (int k = 1; k <= levels; k++) {
+            cv::pyrDown(pyramidNew[k - 1], pyramidNew[k]);
+            cv::pyrDown(pyramidCanvas[k - 1], pyramidCanvas[k]);
+            cv::pyrDown(pyramidMask[k - 1], pyramidMask[k]);
+        }
+
+        // Blend each Laplacian level and collapse, coarse to fine
+        reserveBuffer(pyramidOut[levels], pyramidNew[levels].size(), CV_32FC3);
+        blendLevel(pyramidCanvas[levels], cv::Mat(), pyramidNew[levels], cv::Mat(),
+            pyramidMask[levels], cv::Mat(), pyramidOut[levels]);
+
+        for (int k = levels - 1; k >= 0; k--) {
+            cv::Size size = pyramidNew[k].size();
+            cv::pyrUp(pyramidNew[k + 1], pyramidUpNew[k], size);
+            cv::pyrUp(pyramidCanvas[k + 1], pyramidUpCanvas[k], size);
+            cv::pyrUp(pyramidOut[k + 1], pyramidUpOut[k], size);
+            reserveBuffer(pyramidOut[k], size, CV_32FC3);
+            blendLevel(pyramidCanvas[k], pyramidUpCanvas[k], pyramidNew[k], pyramidUpNew[k],
+                pyramidMask[k], pyramidUpOut[k], pyramidOut[k]);
+        }
+
+        // Next band needs this band's original bottom rows as its top margin
+        int carryRows = std::min(margin, y1 - top);
+        reserveBuffer(bandCarry, cv::Size(nCols, carryRows), CV_8UC3);
+        bandCanvas(cv::Rect(0, y1 - top - carryRows, nCols, carryRows)).copyTo(bandCarry);
+
+        // Write back the band's own rows only
+        cv::Mat result = canvas(cv::Rect(0, y0, nCols, y1 - y0));
+        pyramidOut[0](cv::Rect(padLeft, y0 - top + padTop, nCols, y1 - y0)).convertTo(result, CV_8UC3);
+
+    }
+
+    return 0;
+
+}
+
+
+// Seam cost of one overlap row: color difference where both images have
+// content, plus a small pull toward equal alphas so flat regions cut through
+// the middle. Pixels only one image covers are priced out of the seam
+// -----------------------------------------------------------------------------
+template <typename M>
+static void seamCostRow(const uchar* rowNew, const uchar* rowCan, const M* alphaNew,
+    const M* alphaCan, double alphaMax, int x0, int x1, int* cost){
+
+    const int excluded = 1 << 12; // Above any difference plus pull
+    const double pull = 32.0 / alphaMax; // Full alpha imbalance costs 32 levels
+
+    for (int x = x0; x < x1; x++) {
+        const uchar* n = rowNew + 3*x;
+        const uchar* c = rowCan + 3*x;
+        if(!hasContent(n) || !hasContent(c)){
+            cost[x] = excluded;
+            continue;
+        }
+        int diff = abs(n[0] - c[0]) + abs(n[1] - c[1]) + abs(n[2] - c[2]);
+        cost[x] = diff + (int) (pull * fabs((double) alphaNew[x] - (double) alphaCan[x]));
+    }
+
+}
+
+
+// Composites one overlap row around its seam column. Away from the seam each
+// side keeps its own image, filling in from the other only where it is empty,
+// and a feather band of 2 * band columns hides the cut itself
+// -----------------------------------------------------------------------------
+static void seamRow(const uchar* rowNew, uchar* rowCan, int nCols, int seam, int band,
+    bool newOnRight, ushort* weights){
+
+    int b0 = std::max(0, seam - band);
+    int b1 = std::min(nCols, seam + band);
+
+    for (int x = 0; x < nCols; x++) {
+        if(x == b0){ x = b1 - 1; continue; } // Band is blended below
+        bool newSide = (x >= seam) == newOnRight;
+        const uchar* n = rowNew + 3*x;
+        uchar* c = rowCan + 3*x;
+        if(newSide ? hasContent(n) : !hasContent(c)){
+            c[0] = n[0];
+            c[1] = n[1];
+            c[2] = n[2];
+        }
+    }
+
+    for (int x = b0; x < b1; x++) {
+        double t = (x - (seam - band) + 0.5) / (2.0 * band);
+        int w = (int) (256.0 * (newOnRight ? t : 1.0 - t) + 0.5);
+        if(!hasContent(rowCan + 3*x)) w = 256;
+        else if(!hasContent(rowNew + 3*x)) w = 0;
+        ushort* wx = weights + 3*(x - b0);
+        wx[0] = wx[1] = wx[2] = (ushort) w;
+    }
+
+    if(b1 > b0) featherRow(rowNew + 3*b0, rowCan + 3*b0, weights, 3*(b1 - b0));
+
+}
+
+
+// Cuts an overlap tile along its cheapest top to bottom seam, one column per
+// row moving at most one column between rows, found by dynamic programming.
+// The new image keeps the side it extends to. With a seam from the previous
+// frame for the same overlap, only a window around it is searched, so video
+// seams track moving objects at a cost proportional to seam length
+// -----------------------------------------------------------------------------
+int RadialStitcher::blendSeam(cv::Mat& newImage, cv::Mat& canvas, cv::Mat& newMask, cv::Mat& canvasMask,
+    bool newOnRight, int t, cv::Rect overlap){
+
+    if(newImage.size() != canvas.size()) return -1; // Check same size
+    if(newImage.type() != CV_8UC3 || newMask.type() != canvasMask.type()) return -1;
+
+    int nRows = canvas.rows;
+    int nCols = canvas.cols;
+    const int infinity = INT_MAX / 2;
+
+    if((int) seams.size() <= t) seams.resize(t + 1);
+    Seam& seam = seams[t];
+
+    // Previous seam only helps if it was cut through this same overlap
+    bool incremental = seam.overlap == overlap && (int) seam.columns.size() == nRows
+        && settings.seamWindow > 0;
+    if(!incremental){
+        seam.overlap = overlap;
+        seam.columns.assign(nRows, nCols / 2);
+    }
+
+    int window = incremental ? settings.seamWindow : nCols;
+
+    double alphaMax = 1.0;
+    if(newMask.depth() == CV_8U) alphaMax = 255.0;
+    else if(newMask.depth() == CV_16U) alphaMax = 65535.0;
+
+    // Accumulated cost, only the searched window of each row is valid
+    reserveBuffer(seamCost, canvas.size(), CV_32SC1);
+    seamRange.resize(nRows);
+
+    for (int y = 0; y < nRows; y++) {
+
+        int x0 = std::max(0, seam.columns[y] - window);
+        int x1 = std::min(nCols, seam.columns[y] + window + 1);
+        seamRange[y] = cv::Range(x0, x1);
+
+        int* cost = seamCost.ptr<int>(y);
+        const uchar* rowNew = newImage.ptr<uchar>(y);
+        const uchar* rowCan = canvas.ptr<uchar>(y);
+
+        switch (newMask.depth()) {
+            case CV_8U:
+                seamCostRow(rowNew, rowCan, newMask.ptr<uchar>(y), canvasMask.ptr<uchar>(y), alphaMax, x0, x1, cost);
+                break;
+            case CV_16U:
+                seamCostRow(rowNew, rowCan, newMask.ptr<ushort>(y), canvasMask.ptr<ushort>(y), alphaMax, x0, x1, cost);
+                break;
+            case CV_64F:
+                seamCostRow(rowNew, rowCan, newMask.ptr<double>(y), canvasMask.ptr<double>(y), alphaMax, x0, x1, cost);
+                break;
+            default:
+                return -1;
+        }
+
+        if(y == 0) continue;
+
+        const int* above = seamCost.ptr<int>(y - 1);
+        cv::Range prev = seamRange[y - 1];
+
+        for (int x = x0; x < x1; x++) {
+            int best = infinity;
+            for (int dx = -1; dx <= 1; dx++) {
+                int px = x + dx;
+                if(px >= prev.start && px < prev.end) best = std::min(best, above[px]);
+            }
+            cost[x] = best < infinity ? cost[x] + best : infinity;
+        }
+
+    }
+
+    // Cheapest end point, then walk back up through the cheapest parents
+    const int* last = seamCost.ptr<int>(nRows - 1);
+    int x = seamRange[nRows - 1].start;
+    for (int c = seamRange[nRows - 1].start; c < seamRange[nRows - 1].end; c++) {
+        if(last[c] < last[x]) x = c;
+    }
+    seam.columns[nRows - 1] = x;
+
+    for (int y = nRows - 1; y > 0; y--) {
+        const int* above = seamCost.ptr<int>(y - 1);
+        cv::Range prev = seamRange[y - 1];
+        int best = -1;
+        for (int dx = -1; dx <= 1; dx++) {
+            int px = x + dx;
+            if(px < prev.start || px >= prev.end) continue;
+            if(best < 0 || above[px] < above[best]) best = px;
+        }
+        if(best < 0) best = std::min(std::max(x, prev.start), prev.end - 1); // Windows drifted apart
+        x = best;
+        seam.columns[y - 1] = x;
+    }
+
+    // Composite around the seam
+    int band = std::max(1, settings.seamBand);
+    featherScratch.resize(3 * 2 * band);
+    for (int y = 0; y < nRows; y++) {
+        seamRow(newImage.ptr<uchar>(y), canvas.ptr<uchar>(y), nCols, seam.columns[y], band,
+            newOnRight, &featherScratch[0]);
+    }
+
+    return 0;
+
+}
+
+
+// Main stitching process
+int RadialStitcher::Stitch(cv::Mat& panorama){
+
+    if(!calibrated && estimateTransforms()) return -1;
+
+    return compose(panorama);
+
+}
+
+
+// Recovers the translation of every image relative to the first one and
+// sizes the output canvas
+// -----------------------------------------------------------------------------
+int RadialStitcher::estimateTransforms(){
+
+    // Register at native resolution, the output scale follows from the result
+    if((srcScale != 1.0 || srcStale) && prewarpFrames(1.0)) return -1;
+
+    // Use first image to start panorama
+    cv::Mat first = src[0];
+    if(!first.data) return -1;
+
+    // A closed loop spans exactly one turn, 2 pi f wide and half that high,
+    // open strips get the bounding box of the placed images afterward
+    imageSize = first.size();
+    bool closed = closedLoop();
+    if(closed){
+        int width = cvRound(2 * CV_PI * settings.focalLength);
+        canvasSize = cv::Size(width, width / 2);
+    }
+
+    // Center first image on the horizon of a closed loop
+    double xCenter = 0;
+    double yCenter = closed ? -first.rows/2 + canvasSize.height/2 : 0;
+
+    cv::Mat Tr = (cv::Mat_<double>(3,3) << // Translation to center first image of panorama
+        1, 0, xCenter,
+        0, 1, yCenter,
+        0, 0, 1);
+
+    transforms.clear();
+    transforms.push_back(Tr); // First homography for first input image
+
+    detectFeatures();
+
+    // Split the matching time cap evenly between pairs
+    int numPairs = closed ? numImages : numImages - 1;
+    matchBudget = 0;
+    if(settings.maxMatchTime > 0 && numPairs > 0){
+        matchBudget = (int64) (settings.maxMatchTime * 1e-3 * cv::getTickFrequency() / numPairs);
+    }
+
+    // Translation of every image onto its left neighbor, shifts[0] closes
+    // the loop from the last image back onto the first
+    std::vector<cv::Point2d> shifts(numImages, cv::Point2d(0, 0));
+
+    for (int i = closed ? 0 : 1; i < numImages; i++) {
+
+        int curr = i; // Current image to stitch in...
+        int left = (i + numImages - 1) % numImages; // ...And its left neighbor image
+
+        cv::Mat H = (cv::Mat_<double>(3,3) << // Modify this to relate curr image to neighbor
+            1, 0, 0,
+            0, 1, 0,
+            0, 0, 1);
+
+        // Find translation
+        Profiler::Mark start = profiler.mark();
+        int status = matchFeatures(curr, left);
+        profiler.stage("match", start, curr, "matches", status ? 0 : (double) matches[curr].size());
+
+        // Inliers are reported even when too few, they show why a pair failed
+        start = profiler.mark();
+        bool matched = !status;
+        if(matched) status = estimateHomography(curr, left, H);
+        profiler.stage("estimate", start, curr, "inliers", matched ? pairInliers[curr] : 0);
+
+        // Coarse matches are only good to a few pixels of full resolution,
+        // a pair that keeps its coarse estimate is counted as 0
+        if(!status && settings.matchScale > 1){
+            start = profiler.mark();
+            bool refined = !refineTranslation(curr, left, H);
+            profiler.stage("refine", start, curr, "refined", refined ? 1 : 0);
+        }
+
+        if(status){
+            std::cout << "Images " << left << " and " << curr << " could not be matched." << std::endl;
+            return -1;
+        }
+
+        shifts[i] = cv::Point2d(H.at<double>(0, 2), H.at<double>(1, 2));
+
+    }
+
+    if(closed) distributeDrift(shifts, canvasSize.width);
+
+    // Register remaining images relative to first image
+    for (int i = 1; i < numImages; i++) {
+
+        // Use this matrix to find the chain of transformations relating curr
+        // image to the first image
+        cv::Mat C = (cv::Mat_<double>(3,3) <<
+            1, 0, 0,
+            0, 1, 0,
+            0, 0, 1);
+
+        // Stack all previous translations and...
+        C.at<double>(0, 2) += transforms[i - 1].at<double>(0, 2);
+        C.at<double>(1, 2) += transforms[i - 1].at<double>(1, 2);
+
+        //...add new homography for curr image
+        C.at<double>(0, 2) += shifts[i].x;
+        C.at<double>(1, 2) += shifts[i].y;
+
+        transforms.push_back(C);
+
+    }
+
+    return finishRegistration();
+
+}
+
+
+// Sizes the canvas for new transforms and reprojects the current frames at
+// the output scale, so the canvas is allocated once at its final size
+// -----------------------------------------------------------------------------
+int RadialStitcher::finishRegistration(){
+
+    if(!closedLoop()) fitCanvas();
+    updateOutputScale();
+
+    // Output scale prewarps are left to compose, a banded one never makes
+    // them. Gains are measured on the placed images though, and go into the
+    // next prewarp
+    if(settings.exposure != EXPOSURE_NONE){
+        if((srcScale != outputScale || srcStale) && prewarpFrames(outputScale)) return -1;
+        if(estimateGains(1.0)) return -1;
+        framesSinceGains = 0;
+        srcStale = true;
+    }
+
+    return 0;
+
+}
+
+
+// Shrinks an open strip's canvas to the bounding box of the placed images and
+// shifts the transforms so the box starts at the origin. Shifts are whole
+// pixels so placement rounds exactly as before
+// -----------------------------------------------------------------------------
+int RadialStitcher::fitCanvas(){
+
+    int x0 = INT_MAX, y0 = INT_MAX;
+    int x1 = INT_MIN, y1 = INT_MIN;
+
+    for (int i = 0; i < numImages; i++) {
+        int x = cvRound(transforms[i].at<double>(0, 2));
+        int y = cvRound(transforms[i].at<double>(1, 2));
+        x0 = std::min(x0, x);
+        y0 = std::min(y0, y);
+        x1 = std::max(x1, x + imageSize.width);
+        y1 = std::max(y1, y + imageSize.height);
+    }
+
+    for (int i = 0; i < numImages; i++) {
+        transforms[i].at<double>(0, 2) -= x0;
+        transforms[i].at<double>(1, 2) -= y0;
+    }
+
+    canvasSize = cv::Size(x1 - x0, y1 - y0);
+
+    return 0;
+
+}
+
+
+// Output canvas is the native canvas resampled to settings.outputWidth
+// -----------------------------------------------------------------------------
+void RadialStitcher::updateOutputScale(){
+
+    outputScale = 1.0;
+    outputSize = canvasSize;
+
+    if(settings.outputWidth > 0 && canvasSize.width > 0){
+        outputScale = (double) settings.outputWidth / canvasSize.width;
+        outputSize = cv::Size(settings.outputWidth, cvRound(canvasSize.height * outputScale));
+    }
+
+}
+
+
+// Keeps gains current in video. Once registered every gainInterval frame sets
+// re-measure the overlaps and move the gains part way, so exposure changes are
+// followed without flicker. The first measurement is applied in full
+// -----------------------------------------------------------------------------
+int RadialStitcher::updateGains(){
+
+    if(settings.exposure == EXPOSURE_NONE) return 0;
+    if((int) transforms.size() != numImages) return 0; // Not placed yet
+
+    bool first = gainTables[0].empty();
+    if(!first && ++framesSinceGains < std::max(1, settings.gainInterval)) return 0;
+
+    // Overlaps are measured on this set's prewarp at output scale
+    framesSinceGains = 0;
+    if((srcScale != outputScale || srcStale) && prewarpFrames(outputScale)) return -1;
+    if(estimateGains(first ? 1.0 : settings.gainSmoothing)) return -1;
+
+    // Later frames pick the new tables up in their prewarp, the first one
+    // must not go out uncorrected
+    if(first) srcStale = true;
+
+    return 0;
+
+}
+
+
+// Re-measures gains from a frame set right away, for a backend that composes
+// frames without handing them to setImages. Moves gains gainSmoothing of the
+// way like updateGains, the caller decides how often
+// -----------------------------------------------------------------------------
+int RadialStitcher::measureGains(std::vector<cv::Mat>& images){
+
+    if(settings.exposure == EXPOSURE_NONE) return 0;
+    if((int) transforms.size() != numImages || (int) images.size() != numImages) return -1; // Not placed yet
+
+    for (int i = 0; i < numImages; i++) {
+        if(!images[i].data || images[i].size() != imageSize) return -1;
+        frames[i] = images[i];
+    }
+
+    // Overlaps are measured on the prewarp, which carries the current gains
+    if(prewarpFrames(outputScale)) return -1;
+
+    bool first = gainTables[0].empty();
+    framesSinceGains = 0;
+
+    return estimateGains(first ? 1.0 : settings.gainSmoothing);
+
+}
+
+
+// One channel of an overlap sum, or the mean of all three for a single gain
+// -----------------------------------------------------------------------------
+static double channelSum(const cv::Vec3d& sum, int c, int channels){
+
+    return channels == 1 ? (sum[0] + sum[1] + sum[2]) / 3 : sum[c];
+
+}
+
+
+// Solves for the gains that make overlapping images agree (Brown & Lowe 2007)
+// minimizing sum N_ij ((g_i I_ij - g_j I_ji)^2 / sn^2 + (1 - g_i)^2 / sg^2)
+// where I_ij is the mean of image i over its overlap with j and N_ij the pixel
+// count. The prior keeps gains near 1 so the whole panorama does not drift.
+// src already carries the current gains, they are divided back out first.
+// smoothing is the weight of the new solution against the running gains
+// -----------------------------------------------------------------------------
+int RadialStitcher::estimateGains(double smoothing){
+
+    const double noise = 10.0; // sn, intensity levels
+    const double prior = 0.1; // sg
+    const int step = 2; // Means are smooth, every other pixel is plenty
+
+    if(getTiles(tiles)) return -1;
+
+    // Channel sums of each image over its overlap with each neighbor
+    std::vector<double> count(numImages * numImages, 0.0);
+    std::vector<cv::Vec3d> sum(numImages * numImages, cv::Vec3d(0, 0, 0));
+
+    for (size_t t = 0; t < tiles.size(); t++) {
+
+        getMaskPatches(tiles, (int) t, patches);
+        int i = tiles[t].image;
+
+        for (size_t p = 0; p < patches.size(); p++) {
+
+            int j = patches[p].image;
+            cv::Mat a = src[i](patches[p].target + tiles[t].imageRect.tl());
+            cv::Mat b = src[j](patches[p].source);
+
+            for (int y = 0; y < a.rows; y += step) {
+
+                const uchar* pa = a.ptr<uchar>(y);
+                const uchar* pb = b.ptr<uchar>(y);
+
+                for (int x = 0; x < a.cols; x += step) {
+
+                    const uchar* ca = pa + 3*x;
+                    const uchar* cb = pb + 3*x;
+                    if(!hasContent(ca) || !hasContent(cb)) continue; // Off an image
+
+                    count[i*numImages + j] += 1;
+                    for (int c = 0; c < 3; c++) {
+                        sum[i*numImages + j][c] += ca[c];
+                        sum[j*numImages + i][c] += cb[c];
+                    }
+
+                }
+            }
+        }
+    }
+
+    // Normal equations, one system per channel, or one on the channel mean
+    int channels = settings.exposure == EXPOSURE_CHANNELS ? 3 : 1;
+    std::vector<cv::Vec3d> solved(numImages, cv::Vec3d(1, 1, 1));
+
+    for (int c = 0; c < channels; c++) {
+
+        cv::Mat A = cv::Mat::zeros(numImages, numImages, CV_64F);
+        cv::Mat b = cv::Mat::zeros(numImages, 1, CV_64F);
+
+        for (int i = 0; i < numImages; i++) {
+            for (int j = 0; j < numImages; j++) {
+
+                double n = count[i*numImages + j] + count[j*numImages + i]; // Pair is stored once
+                if(i == j || n <= 0) continue;
+
+                double Iij = channelSum(sum[i*numImages + j], c, channels) / n / gains[i][c];
+                double Iji = channelSum(sum[j*numImages + i], c, channels) / n / gains[j][c];
+
+                A.at<double>(i, i) += n * (2 * Iij * Iij / (noise * noise) + 1 / (prior * prior));
+                A.at<double>(i, j) -= n * 2 * Iij * Iji / (noise * noise);
+                b.at<double>(i) += n / (prior * prior);
+
+            }
+
+            if(A.at<double>(i, i) == 0){ // No overlap, keep it as it is
+                A.at<double>(i, i) = 1;
+                b.at<double>(i) = 1;
+            }
+        }
+
+        cv::Mat g;
+        if(!cv::solve(A, b, g, cv::DECOMP_CHOLESKY)) return -1;
+
+        for (int i = 0; i < numImages; i++) {
+            double gain = std::min(2.0, std::max(0.5, g.at<double>(i)));
+            for (int k = (channels == 1 ? 0 : c); k < (channels == 1 ? 3 : c + 1); k++) solved[i][k] = gain;
+        }
+
+    }
+
+    // Blend into the running gains and rebuild the tables
+    for (int i = 0; i < numImages; i++) {
+
+        gains[i] = gains[i] * (1.0 - smoothing) + solved[i] * smoothing;
+
+        reserveBuffer(gainTables[i], cv::Size(256, 1), CV_8UC3);
+        uchar* lut = gainTables[i].ptr<uchar>();
+        for (int v = 0; v < 256; v++) {
+            for (int c = 0; c < 3; c++) lut[3*v + c] = cv::saturate_cast<uchar>(v * gains[i][c]);
+        }
+
+    }
+
+    return 0;
+
+}
+
+
+// Going all the way around must come back to the start, one circumference
+// over and level. Matching errors make the pair shifts miss that, so the
+// residual is spread over every pair by weighted least squares: minimizing
+// sum w_i (s_i' - s_i)^2 subject to sum s_i' = target gives each pair a share
+// proportional to 1 / w_i, pairs with more inliers are trusted more and move less
+// -----------------------------------------------------------------------------
+int RadialStitcher::distributeDrift(std::vector<cv::Point2d>& shifts, int circumference){
+
+    cv::Point2d sum(0, 0);
+    double spread = 0;
+
+    for (int i = 0; i < numImages; i++) {
+        sum += shifts[i];
+        spread += 1.0 / std::max(1, pairInliers[i]);
+    }
+
+    cv::Point2d residual(circumference - sum.x, -sum.y);
+
+    std::cout << "Loop closure residual " << residual.x << ", " << residual.y << " px" << std::endl;
+    if(fabs(residual.x) > 0.5 * imageSize.width){ // Correction would tear images apart
+        std::cout << "Loop does not close, check the focal length." << std::endl;
+    }
+
+    for (int i = 0; i < numImages; i++) {
+        double share = (1.0 / std::max(1, pairInliers[i])) / spread;
+        shifts[i] += residual * share;
+    }
+
+    return 0;
+
+}
+
+
+// Registers the current frame set and freezes its transforms
+// -----------------------------------------------------------------------------
+int RadialStitcher::calibrate(){
+
+    calibrated = false;
+    if(estimateTransforms()) return -1;
+    calibrated = true;
+
+    return 0;
+
+}
+
+
+// Registers several frame sets from a fixed rig and freezes the average
+// translations, which evens out matching noise of any single set
+// -----------------------------------------------------------------------------
+int RadialStitcher::calibrate(std::vector<std::vector<cv::Mat> >& frameSets){
+
+    int numSets = (int) frameSets.size();
+    if(numSets < 1) return -1;
+
+    calibrated = false;
+    std::vector<cv::Mat> sum(numImages);
+
+    for (int s = 0; s < numSets; s++) {
+
+        transforms.clear(); // Prewarp each set at native scale for registration
+        if(setImages(frameSets[s]) || estimateTransforms()) return -1;
+
+        for (int i = 0; i < numImages; i++) {
+            if(s == 0) sum[i] = transforms[i].clone();
+            else sum[i] += transforms[i];
+        }
+
+    }
+
+    for (int i = 0; i < numImages; i++) {
+        transforms[i] = sum[i] / numSets; // Average translation, bottom row stays 0 0 1
+    }
+
+    if(finishRegistration()) return -1;
+
+    calibrated = true;
+
+    return 0;
+
+}
+
+
+// Writes the frozen transforms along with the prewarp parameters they need
+// -----------------------------------------------------------------------------
+int RadialStitcher::saveCalibration(const std::string& fileName){
+
+    if((int) transforms.size() != numImages) return -1; // Not registered yet
+
+    if(settings.decodeScale != 1){ // Calibrations are in full size pixels
+        std::cout << "Reduced decodes can't be calibrated." << std::endl;
+        return -1;
+    }
+
+    cv::FileStorage fs(fileName, cv::FileStorage::WRITE);
+    if(!fs.isOpened()){
+        std::cout << "Calibration " << fileName << " could not be written." << std::endl;
+        return -1;
+    }
+
+    fs << "numImages" << numImages;
+    fs << "focalLength" << settings.focalLength;
+    fs << "projection" << (settings.projection == SPHERICAL ? "spherical" : "cylindrical");
+    fs << "imageWidth" << imageSize.width;
+    fs << "imageHeight" << imageSize.height;
+    fs << "canvasWidth" << canvasSize.width;
+    fs << "canvasHeight" << canvasSize.height;
+    fs << "closedLoop" << (int) settings.closeLoop;
+    fs << "transforms" << "[";
+    for (int i = 0; i < numImages; i++) fs << transforms[i];
+    fs << "]";
+
+    fs.release();
+
+    return 0;
+
+}
+
+
+// Reads a calibration, must happen before frames are prewarped since it
+// replaces the focal length, projection and loop closure
+// -----------------------------------------------------------------------------
+int RadialStitcher::loadCalibration(const std::string& fileName){
+
+    if(settings.decodeScale != 1){ // Calibrations are in full size pixels
+        std::cout << "Calibrations can't be used with reduced decodes." << std::endl;
+        return -1;
+    }
+
+    cv::FileStorage fs(fileName, cv::FileStorage::READ);
+    if(!fs.isOpened()){
+        std::cout << "Calibration " << fileName << " could not be read." << std::endl;
+        return -1;
+    }
+
+    if((int) fs["numImages"] != numImages){
+        std::cout << "Calibration is for " << (int) fs["numImages"] << " cameras." << std::endl;
+        return -1;
+    }
+
+    cv::FileNode nodes = fs["transforms"];
+    if((int) nodes.size() != numImages) return -1;
+
+    settings.focalLength = (double) fs["focalLength"];
+    settings.projection = ((std::string) fs["projection"] == "cylindrical") ? CYLINDRICAL : SPHERICAL;
+    imageSize = cv::Size((int) fs["imageWidth"], (int) fs["imageHeight"]);
+    canvasSize = cv::Size((int) fs["canvasWidth"], (int) fs["canvasHeight"]);
+    settings.closeLoop = !fs["closedLoop"].empty() && (int) fs["closedLoop"]; // Older files are open strips
+
+    transforms.clear();
+    for (int i = 0; i < numImages; i++) {
+        cv::Mat T;
+        cv::read(nodes[i], T);
+        if(T.rows != 3 || T.cols != 3) return -1;
+        transforms.push_back(T);
+    }
+
+    updateOutputScale();
+    calibrated = true;
+
+    return 0;
+
+}
+
+
+// Fits a loaded calibration to frames of another resolution from the same
+// cameras, e.g. a live view stream. The projection is linear in the focal
+// length, so focal, translations and canvas all scale with the frames
+// -----------------------------------------------------------------------------
+int RadialStitcher::scaleCalibration(cv::Size frameSize){
+
+    if(!calibrated) return -1;
+    if(frameSize == imageSize) return 0;
+
+    double sx = (double) frameSize.width / imageSize.width;
+    double sy = (double) frameSize.height / imageSize.height;
+    if(std::abs(sx - sy) > 0.01 * sx){ // Cropped, not scaled
+        std::cout << "Frames are " << frameSize.width << "x" << frameSize.height << ", calibration is for "
+            << imageSize.width << "x" << imageSize.height << "." << std::endl;
+        return -1;
+    }
+
+    settings.focalLength *= sx;
+    for (int i = 0; i < numImages; i++) {
+        transforms[i].at<double>(0, 2) *= sx;
+        transforms[i].at<double>(1, 2) *= sx;
+    }
+
+    imageSize = frameSize;
+    if(closedLoop()){ // Stays exactly one turn
+        int width = cvRound(2 * CV_PI * settings.focalLength);
+        canvasSize = cv::Size(width, width / 2);
+    } else {
+        canvasSize = cv::Size(cvRound(canvasSize.width * sx), cvRound(canvasSize.height * sx));
+    }
+    updateOutputScale();
+
+    return 0;
+
+}
+
+
+// Places every prewarped image into the canvas with the current transforms
+// and feathers it into its left neighbor. Transforms are pure translations so
+// each image is blitted over its own rectangle only, nothing canvas-sized is
+// allocated besides the canvas itself
+// -----------------------------------------------------------------------------
+int RadialStitcher::compose(cv::Mat& out){
+
+    if((int) transforms.size() != numImages) return -1; // Not registered yet
+
+    // Output width may have changed with the settings since registration
+    updateOutputScale();
+    if(tracking && persistentCanvas.size() == outputSize && !composeChanged(out)) return 0; // Else recompose all
+    if(settings.exposure != EXPOSURE_NONE && gainTables[0].empty() && updateGains()) return -1; // E.g. loaded calibration
+    if((srcScale != outputScale || srcStale) && prewarpFrames(outputScale)) return -1;
+
+    if(!settings.stereo){
+        if(composeView(out)) return -1;
+        return settings.refreshInterval > 0 ? keepCanvas(out) : 0;
+    }
+
+    // Eyes share the prewarp and only differ in strips and blend, each is
+    // composed into its half of out with its own masks and seams
+    reserveBuffer(out, getCanvasSize(), src[0].type());
+    if(updateEyes()) return -1;
+
+    int status = 0;
+    for (int e = 0; e < 2 && !status; e++) {
+        cv::Mat view = out.rowRange(e * outputSize.height, (e + 1) * outputSize.height);
+        eye = e;
+        std::swap(blendMasks, eyes[e].masks);
+        std::swap(seams, eyes[e].seams);
+        status = composeView(view);
+        std::swap(blendMasks, eyes[e].masks);
+        std::swap(seams, eyes[e].seams);
+    }
+    eye = -1;
+
+    return status;
+
+}
+
+
+// Places every tile and blends it into its left neighbor, for the mono
+// panorama or, with eye set, one eye's strips
+// -----------------------------------------------------------------------------
+int RadialStitcher::composeView(cv::Mat& out){
+
+    Profiler::Mark start = profiler.mark();
+    reserveBuffer(out, outputSize, src[0].type()); // Reused when caller passes it back
+    out.setTo(cv::Scalar::all(0));
+
+    getTiles(tiles);
+    tileMasks.resize(tiles.size());
+
+    cv::Rect filled; // Bounding box of everything placed so far, canvas is empty outside
+
+    for (size_t t = 0; t < tiles.size(); t++) {
+
+        const Tile& tile = tiles[t];
+        int i = tile.image;
+        cv::Mat warped = src[i](tile.imageRect); // Translated image...
+
+        // Copy in first tile
+        if(t == 0){
+            warped.copyTo(out(tile.canvasRect));
+            filled = tile.canvasRect;
+            continue;
+        }
+
+        cv::Mat newMask = blendMasks[i](tile.imageRect); // ...and its mask
+
+        // Neighbors' masks as already placed, over this tile only
+        cv::Mat& prevMask = tileMasks[t];
+        reserveBuffer(prevMask, tile.canvasRect.size(), blendMasks[i].type());
+        prevMask.setTo(cv::Scalar::all(0));
+        getMaskPatches(tiles, (int) t, patches);
+        for (size_t p = 0; p < patches.size(); p++) {
+            cv::Mat target = prevMask(patches[p].target);
+            cv::max(target, blendMasks[patches[p].image](patches[p].source), target);
+        }
+
+        // Blend and add to panorama
+        if(settings.blendMode == FEATHER_REFERENCE){
+            cv::Mat canvas = out(tile.canvasRect);
+            blend(warped, canvas, newMask, prevMask);
+        } else {
+            blendRect(warped, out, tile.canvasRect, newMask, prevMask, filled, (int) t);
+        }
+
+        filled = filled.area() > 0 ? (filled | tile.canvasRect) : tile.canvasRect;
+
+    }
+
+    profiler.stage("blend", start, -1, "tiles", (double) tiles.size());
+
+    return 0;
+
+}
+
+
+// Cuts every prewarped image into a strip per eye. The left eye sees rays
+// that pass left of the rig center, which cameras capture right of their
+// optical axis, so its strips are offset right and the right eye's left.
+// Strips are shifted back so each lands centered where its image center
+// did, and reach halfway to the neighbors' centers plus seamBand, which the
+// blend feathers across. Masks are only rebuilt when a strip moves
+// -----------------------------------------------------------------------------
+int RadialStitcher::updateEyes(){
+
+    int margin = std::max(1, settings.seamBand);
+    int turn = outputSize.width; // Neighbor across a closed loop's seam
+
+    std::vector<double> centers(numImages);
+    for (int i = 0; i < numImages; i++) {
+        centers[i] = transforms[i].at<double>(0, 2) * outputScale + src[i].cols / 2.0;
+    }
+
+    double alphaMax = 1.0;
+    if(settings.maskDepth == CV_8U) alphaMax = 255;
+    else if(settings.maskDepth == CV_16U) alphaMax = 65535;
+
+    bool clipped = false;
+    bool rebuilt = false;
+
+    for (int e = 0; e < 2; e++) {
+
+        Eye& view = eyes[e];
+        view.offset = cvRound((e == 0 ? 1 : -1) * settings.stereoOffset * src[0].cols);
+        view.windows.resize(numImages);
+        view.masks.resize(numImages);
+
+        for (int i = 0; i < numImages; i++) {
+
+            int width = src[i].cols;
+            int x = cvRound(transforms[i].at<double>(0, 2) * outputScale) - view.offset;
+
+            // Open strips keep the outer edges of the end images
+            int x0 = 0;
+            int x1 = width;
+            if(i > 0 || closedLoop()){
+                double left = i > 0 ? centers[i - 1] : centers[numImages - 1] - turn;
+                x0 = cvFloor((left + centers[i]) / 2) - margin - x;
+            }
+            if(i < numImages - 1 || closedLoop()){
+                double right = i < numImages - 1 ? centers[i + 1] : centers[0] + turn;
+                x1 = cvCeil((centers[i] + right) / 2) + margin - x;
+            }
+            if(x0 < 0 || x1 > width) clipped = true;
+            x0 = std::max(0, x0);
+            x1 = std::min(width, std::max(x0, x1));
+
+            cv::Rect window(x0, 0, x1 - x0, src[i].rows);
+            cv::Mat& mask = view.masks[i];
+            if(window == view.windows[i] && mask.size() == blendMasks[i].size() &&
+                mask.type() == blendMasks[i].type()) continue;
+
+            view.windows[i] = window;
+            rebuilt = true;
+
+            reserveBuffer(mask, blendMasks[i].size(), blendMasks[i].type());
+            mask.setTo(cv::Scalar::all(0));
+            if(window.width == 0) continue;
+
+            // Neighboring strips share 2 margin columns, ramp across them
+            cv::Mat rampX(1, window.width, CV_64F);
+            double* ramp = rampX.ptr<double>(0);
+            for (int c = 0; c < window.width; c++) {
+                int edgeDist = std::min(c + 1, window.width - c);
+                ramp[c] = std::min(edgeDist / (2.0 * margin), 1.0) * alphaMax;
+            }
+            cv::Mat columnAlpha;
+            rampX.convertTo(columnAlpha, settings.maskDepth);
+
+            for (int y = 0; y < mask.rows; y++) {
+                cv::Mat row = mask.row(y).colRange(x0, x1);
+                cv::min(blendMasks[i].row(y).colRange(x0, x1), columnAlpha, row);
+            }
+
+        }
+
+    }
+
+    if(rebuilt && clipped){
+        std::cout << "Stereo offset leaves too little overlap, eye strips are clipped." << std::endl;
+    }
+
+    return 0;
+
+}
+
+
+// Composes straight into caller memory, e.g. an encoder's input surface.
+// step is the row pitch in bytes, 0 for packed rows
+// -----------------------------------------------------------------------------
+int RadialStitcher::compose(uchar* data, size_t step){
+
+    if(!data || (int) transforms.size() != numImages || !frames[0].data) return -1;
+
+    updateOutputScale();
+    cv::Mat out(getCanvasSize(), frames[0].type(), data, step);
+    if(compose(out)) return -1;
+
+    return out.data == data ? 0 : -1; // Buffer was not reallocated
+
+}
+
+
+// Streaming stitch for panoramas too big to hold, registers unless calibrated
+// -----------------------------------------------------------------------------
+int RadialStitcher::Stitch(const BandWriter& write, int bandRows){
+
+    if(!calibrated && estimateTransforms()) return -1;
+
+    return composeBands(write, bandRows);
+
+}
+
+
+// Composes the panorama one band of rows at a time and hands each to write.
+// Every tile's rows for the band are warped straight from the input frames
+// through the rows of its warp map, so neither the canvas nor full prewarped
+// images are held while composing: memory is the frames plus a band. Prewarps
+// left by registration, or by measuring gains, are released first. Multi-band blending
+// pads each band with enough rows that band edges don't show. Seams need the
+// whole overlap to cut through, so seam mode feathers here
+// -----------------------------------------------------------------------------
+int RadialStitcher::composeBands(const BandWriter& write, int bandRows){
+
+    if((int) transforms.size() != numImages || bandRows < 1) return -1;
+
+    if(settings.stereo) return -1; // Eyes are composed whole
+
+    for (int i = 0; i < numImages; i++) {
+        if(!frames[i].data || frames[i].type() != CV_8UC3) return -1;
+    }
+
+    updateOutputScale();
+    if(settings.exposure != EXPOSURE_NONE && gainTables[0].empty() && updateGains()) return -1;
+
+    BlendMode mode = settings.blendMode;
+    if(mode == SEAM) settings.blendMode = FEATHER;
+
+    // Full size prewarps are what banding avoids, compose rebuilds them if
+    // it runs next
+    for (int i = 0; i < numImages; i++) {
+        src[i].release();
+        blendMasks[i].release();
+    }
+    srcScale = 0;
+
+    int status = prepareRegions();
+
+    int margin = mode == MULTIBAND ? (4 << std::max(0, settings.blendLevels)) : 0;
+    cv::Rect canvas(0, 0, outputSize.width, outputSize.height);
+
+    for (int y = 0; y < outputSize.height && !status; y += bandRows) {
+
+        int rows = std::min(bandRows, outputSize.height - y);
+        cv::Rect region = cv::Rect(0, y - margin, outputSize.width, rows + 2 * margin) & canvas;
+
+        reserveBuffer(bandOut, region.size(), CV_8UC3);
+        bandOut.setTo(cv::Scalar::all(0));
+
+        Profiler::Mark start = profiler.mark();
+        status = composeRegion(region, bandOut);
+        profiler.stage("blend", start, -1, "row", y);
+
+        start = profiler.mark();
+        if(!status) status = write(bandOut.rowRange(y - region.y, y - region.y + rows), y);
+        profiler.stage("encode", start, -1, "row", y);
+
+    }
+
+    settings.blendMode = mode;
+
+    return status ? -1 : 0;
+
+}
+
+
+// Sets up composeRegion: unprojected masks and the tile layout
+// -----------------------------------------------------------------------------
+int RadialStitcher::prepareRegions(){
+
+    // Masks before projection only depend on frame size, share them
+    sourceMasks.resize(numImages);
+    int status = 0;
+    for (int i = 0; i < numImages && !status; i++) {
+        if(sourceMasks[i].size() == frames[i].size() && sourceMasks[i].depth() == settings.maskDepth) continue;
+        if(i > 0 && frames[i].size() == frames[i - 1].size()) sourceMasks[i] = sourceMasks[i - 1];
+        else status = buildBlendMask(frames[i], sourceMasks[i]);
+    }
+
+    getTiles(tiles);
+    tileMasks.resize(tiles.size());
+
+    return status;
+
+}
+
+
+// Composes the part of the canvas inside region into out, region sized
+// Same tile order and blending as compose, on rows warped for the region
+// -----------------------------------------------------------------------------
+int RadialStitcher::composeRegion(cv::Rect region, cv::Mat& out){
+
+    cv::Rect filled; // In out, bounding box of everything placed so far
+
+    for (size_t t = 0; t < tiles.size(); t++) {
+
+        const Tile& tile = tiles[t];
+        int i = tile.image;
+
+        cv::Rect canvasRect = tile.canvasRect & region;
+        if(canvasRect.area() <= 0) continue;
+
+        cv::Rect imageRect = canvasRect - tile.canvasRect.tl() + tile.imageRect.tl();
+        cv::Ptr<const WarpMap> map = getWarpMap(frames[i].size(), settings.focalLength, settings.projection, outputScale);
+
+        if(projectRows(frames[i], regionImage, *map, imageRect, gainTables[i])) return -1;
+
+        cv::Rect local = canvasRect - region.tl();
+        if(filled.area() <= 0){
+            regionImage.copyTo(out(local));
+            filled = local;
+            continue;
+        }
+
+        if(projectRows(sourceMasks[i], regionMask, *map, imageRect, cv::Mat())) return -1;
+
+        // Neighbors' masks under this tile, warped for the region as well
+        cv::Mat& prevMask = tileMasks[t];
+        reserveBuffer(prevMask, local.size(), regionMask.type());
+        prevMask.setTo(cv::Scalar::all(0));
+        getMaskPatches(tiles, (int) t, patches);
+
+        for (size_t p = 0; p < patches.size(); p++) {
+
+            int j = patches[p].image;
+            cv::Rect shared = (patches[p].target + tile.canvasRect.tl()) & canvasRect;
+            if(shared.area() <= 0) continue;
+
+            cv::Rect source = shared - tile.canvasRect.tl() - patches[p].target.tl() + patches[p].source.tl();
+            cv::Ptr<const WarpMap> neighborMap = getWarpMap(frames[j].size(), settings.focalLength,
+                settings.projection, outputScale);
+            if(projectRows(sourceMasks[j], regionPatch, *neighborMap, source, cv::Mat())) return -1;
+
+            cv::Mat target = prevMask(shared - canvasRect.tl());
+            cv::max(target, regionPatch, target);
+
+        }
+
+        if(settings.blendMode == FEATHER_REFERENCE){
+            cv::Mat canvasPart = out(local);
+            blend(regionImage, canvasPart, regionMask, prevMask);
+        } else if(blendRect(regionImage, out, local, regionMask, prevMask, filled, (int) t, region.tl())){
+            return -1;
+        }
+
+        filled |= local;
+
+    }
+
+    return 0;
+
+}
+
+
+// Incremental video needs the kept canvas and an unchanged layout, cells are
+// recomposed from frames so anything the full path does per frame is out
+// -----------------------------------------------------------------------------
+bool RadialStitcher::canTrack(const std::vector<cv::Mat>& images) const{
+
+    if(settings.refreshInterval <= 0 || framesSinceRefresh + 1 >= settings.refreshInterval) return false;
+    if((int) transforms.size() != numImages || srcScale != outputScale) return false; // Not placed yet
+    if(settings.stereo || settings.blendMode == SEAM) return false; // Seams move, eyes are composed whole
+    if(persistentCanvas.size() != outputSize || cellSources.size() != tiles.size()) return false;
+    if((int) previousFrames.size() != numImages) return false;
+
+    for (int i = 0; i < numImages; i++) {
+        const cv::Mat& previous = previousFrames[i];
+        if(images[i].depth() != CV_8U || images[i].size() != previous.size() || images[i].type() != previous.type()) return false;
+        if(images[i].data == previous.data) return false; // Caller reused the buffer, nothing to compare
+    }
+
+    return true;
+
+}
+
+
+// Compares every camera's frame to its previous one in changeBlock squares,
+// on every other row. A block changed when its mean absolute difference per
+// sample passes changeThreshold. Kept as an integral image so any source
+// rectangle can be checked in constant time
+// -----------------------------------------------------------------------------
+int RadialStitcher::trackChanges(){
+
+    Profiler::Mark start = profiler.mark();
+    changedBlocks.resize(numImages);
+    std::vector<int> changed(numImages, 0);
+
+    parallelFor(numImages, [&](int i){
+
+        const cv::Mat& frame = frames[i];
+        const cv::Mat& previous = previousFrames[i];
+        int channels = frame.channels();
+        int blocksX = (frame.cols + changeBlock - 1) / changeBlock;
+        int blocksY = (frame.rows + changeBlock - 1) / changeBlock;
+
+        cv::Mat flags(blocksY, blocksX, CV_8U);
+        std::vector<int> sums(blocksX);
+
+        for (int by = 0; by < blocksY; by++) {
+
+            std::fill(sums.begin(), sums.end(), 0);
+            int y0 = by * changeBlock;
+            int y1 = std::min(frame.rows, y0 + changeBlock);
+
+            for (int y = y0; y < y1; y += 2) {
+                const uchar* a = frame.ptr<uchar>(y);
+                const uchar* b = previous.ptr<uchar>(y);
+                for (int bx = 0; bx < blocksX; bx++) {
+                    int x0 = bx * changeBlock * channels;
+                    int x1 = std::min(frame.cols, (bx + 1) * changeBlock) * channels;
+                    int sum = 0;
+                    for (int x = x0; x < x1; x++) sum += std::abs(a[x] - b[x]);
+                    sums[bx] += sum;
+                }
+            }
+
+            int rows = (y1 - y0 + 1) / 2;
+            for (int bx = 0; bx < blocksX; bx++) {
+                int cols = std::min(frame.cols, (bx + 1) * changeBlock) - bx * changeBlock;
+                bool moved = sums[bx] > settings.changeThreshold * rows * cols * channels;
+                flags.at<uchar>(by, bx) = moved ? 1 : 0;
+                changed[i] += moved ? 1 : 0;
+            }
+
+        }
+
+        cv::integral(flags, changedBlocks[i], CV_32S);
+
+    });
+
+    int total = 0;
+    for (int i = 0; i < numImages; i++) total += changed[i];
+    profiler.stage("track", start, -1, "blocks", total);
+
+    return 0;
+
+}
+
+
+// Keeps a fully composed panorama for incremental frames to update, and
+// finds the frame pixels every canvas cell samples through each tile
+// -----------------------------------------------------------------------------
+int RadialStitcher::keepCanvas(const cv::Mat& out){
+
+    reserveBuffer(persistentCanvas, out.size(), out.type());
+    out.copyTo(persistentCanvas);
+
+    int cellsX = (outputSize.width + changeCell - 1) / changeCell;
+    int cellsY = (outputSize.height + changeCell - 1) / changeCell;
+
+    cellSources.resize(tiles.size());
+    for (size_t t = 0; t < tiles.size(); t++) {
+        getWarpMap(frames[tiles[t].image].size(), settings.focalLength, settings.projection, outputScale);
+    }
+
+    parallelFor((int) tiles.size(), [&](int t){
+
+        const Tile& tile = tiles[t];
+        cv::Size frameSize = frames[tile.image].size();
+        cv::Ptr<const WarpMap> warp = getWarpMap(frameSize, settings.focalLength, settings.projection, outputScale);
+        const WarpMap& map = *warp;
+        bool fixedPoint = map.map1.type() == CV_16SC2;
+
+        std::vector<cv::Rect>& sources = cellSources[t];
+        sources.assign(cellsX * cellsY, cv::Rect());
+
+        for (int cy = 0; cy < cellsY; cy++) {
+            for (int cx = 0; cx < cellsX; cx++) {
+
+                cv::Rect cell = cv::Rect(cx * changeCell, cy * changeCell, changeCell, changeCell) & tile.canvasRect;
+                if(cell.area() <= 0) continue;
+                cv::Rect area = cell - tile.canvasRect.tl() + tile.imageRect.tl();
+
+                // Bounding box of the sampled coordinates, one more pixel for
+                // the bilinear neighbors
+                int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+                for (int y = area.y; y < area.y + area.height; y++) {
+                    const short* xy = fixedPoint ? map.map1.ptr<short>(y) : 0;
+                    const float* mapX = fixedPoint ? 0 : map.map1.ptr<float>(y);
+                    const float* mapY = fixedPoint ? 0 : map.map2.ptr<float>(y);
+                    for (int x = area.x; x < area.x + area.width; x++) {
+                        int sx = fixedPoint ? xy[2 * x] : cvFloor(mapX[x]);
+                        int sy = fixedPoint ? xy[2 * x + 1] : cvFloor(mapY[x]);
+                        x0 = std::min(x0, sx);
+                        y0 = std::min(y0, sy);
+                        x1 = std::max(x1, sx + 1);
+                        y1 = std::max(y1, sy + 1);
+                    }
+                }
+
+                sources[cy * cellsX + cx] = cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1) &
+                    cv::Rect(0, 0, frameSize.width, frameSize.height);
+
+            }
+        }
+
+    });
+
+    return 0;
+
+}
+
+
+// Recomposes the canvas cells that sample a changed block of any camera, a
+// run of cells along a row at a time, into the kept canvas and hands that out.
+// Multi-band runs are padded like bands so their edges don't show
+// -----------------------------------------------------------------------------
+int RadialStitcher::composeChanged(cv::Mat& out){
+
+    Profiler::Mark start = profiler.mark();
+
+    if(prepareRegions() || cellSources.size() != tiles.size()) return -1;
+
+    int cellsX = (outputSize.width + changeCell - 1) / changeCell;
+    int cellsY = (outputSize.height + changeCell - 1) / changeCell;
+    reserveBuffer(cellDirty, cv::Size(cellsX, cellsY), CV_8U);
+    cellDirty.setTo(cv::Scalar::all(0));
+
+    for (size_t t = 0; t < tiles.size(); t++) {
+
+        const cv::Mat& blocks = changedBlocks[tiles[t].image];
+        int blocksX = blocks.cols - 1;
+        int blocksY = blocks.rows - 1;
+
+        for (int c = 0; c < cellsX * cellsY; c++) {
+
+            const cv::Rect& source = cellSources[t][c];
+            if(source.area() <= 0) continue;
+
+            int bx0 = source.x / changeBlock;
+            int by0 = source.y / changeBlock;
+            int bx1 = std::min(blocksX, (source.x + source.width - 1) / changeBlock + 1);
+            int by1 = std::min(blocksY, (source.y + source.height - 1) / changeBlock + 1);
+            int count = blocks.at<int>(by1, bx1) - blocks.at<int>(by0, bx1) -
+                blocks.at<int>(by1, bx0) + blocks.at<int>(by0, bx0);
+            if(count > 0) cellDirty.at<uchar>(c / cellsX, c % cellsX) = 1;
+
+        }
+
+    }
+
+    int margin = settings.blendMode == MULTIBAND ? (4 << std::max(0, settings.blendLevels)) : 0;
+    cv::Rect canvas(0, 0, outputSize.width, outputSize.height);
+    int dirty = 0;
+    int status = 0;
+
+    for (int cy = 0; cy < cellsY && !status; cy++) {
+        for (int cx = 0; cx < cellsX && !status; cx++) {
+
+            if(!cellDirty.at<uchar>(cy, cx)) continue;
+
+            int run = cx;
+            while (run < cellsX && cellDirty.at<uchar>(cy, run)) run++;
+            dirty += run - cx;
+
+            cv::Rect cells = cv::Rect(cx * changeCell, cy * changeCell, (run - cx) * changeCell, changeCell) & canvas;
+            cv::Rect region = cv::Rect(cells.x - margin, cells.y - margin, cells.width + 2 * margin,
+                cells.height + 2 * margin) & canvas;
+
+            reserveBuffer(bandOut, region.size(), persistentCanvas.type());
+            bandOut.setTo(cv::Scalar::all(0));
+            status = composeRegion(region, bandOut);
+            if(!status) bandOut(cells - region.tl()).copyTo(persistentCanvas(cells));
+
+            cx = run;
+
+        }
+    }
+
+    if(status) return -1;
+
+    reserveBuffer(out, outputSize, persistentCanvas.type());
+    persistentCanvas.copyTo(out);
+    profiler.stage("blend", start, -1, "dirty", (double) dirty / (cellsX * cellsY));
+
+    return 0;
+
+}
+
+
+// Projects rows of a prewarped image's rectangle straight from the frame,
+// through the same rows of its warp map. O is resized to the rectangle. A
+// nonempty table applies exposure gains on the way
+// -----------------------------------------------------------------------------
+int RadialStitcher::projectRows(cv::Mat &I, cv::Mat&O, const WarpMap& map, cv::Rect rows, const cv::Mat& table){
+
+    if((rows & cv::Rect(0, 0, map.map1.cols, map.map1.rows)) != rows) return -1;
+
+    WarpMap part;
+    part.map1 = map.map1(rows);
+    if(!map.map2.empty()) part.map2 = map.map2(rows);
+    part.srcSize = map.srcSize;
+    part.interpolation = map.interpolation;
+
+    reserveBuffer(O, rows.size(), I.type());
+
+    if(!table.empty() && settings.exposure != EXPOSURE_NONE) return projectWithGain(I, O, part, table);
+
+    return projectWithMap(I, O, part);
+
+}
+
+
+// Every on-canvas piece of every image in compositing order. Open strips get
+// one tile per image, a closed loop also tries each image one turn either
+// side so whatever hangs past the seam lands on the other edge
+// -----------------------------------------------------------------------------
+int RadialStitcher::getTiles(std::vector<Tile>& tiles){
+
+    tiles.clear();
+    if((int) transforms.size() != numImages) return -1; // Not registered yet
+
+    int turns = closedLoop() ? 1 : 0;
+
+    for (int i = 0; i < numImages; i++) {
+        for (int wrap = -turns; wrap <= turns; wrap++) {
+            Tile tile;
+            tile.image = i;
+            if(placement(i, tile.canvasRect, tile.imageRect, wrap)) tiles.push_back(tile);
+        }
+    }
+
+    return 0;
+
+}
+
+
+// Masks tile t feathers against, from earlier tiles of its left neighbor and,
+// closing the loop, the first image under the last one
+// -----------------------------------------------------------------------------
+int RadialStitcher::getMaskPatches(const std::vector<Tile>& tiles, int t, std::vector<MaskPatch>& patches){
+
+    patches.clear();
+
+    int i = tiles[t].image;
+    int left = i - 1;
+    int wrapped = (closedLoop() && i == numImages - 1) ? 0 : -1;
+
+    for (int u = 0; u < t; u++) {
+
+        int j = tiles[u].image;
+        if(j != left && j != wrapped) continue;
+
+        cv::Rect shared = tiles[u].canvasRect & tiles[t].canvasRect;
+        if(shared.area() <= 0) continue;
+
+        MaskPatch patch;
+        patch.image = j;
+        patch.source = shared - tiles[u].canvasRect.tl() + tiles[u].imageRect.tl();
+        patch.target = shared - tiles[t].canvasRect.tl();
+        patches.push_back(patch);
+
+    }
+
+    return 0;
+
+}
+
+
+// Blends tile t placed at canvasRect into the canvas. Only the part that
+// overlaps already filled canvas goes through the feather, multi-band or seam
+// blender, the rest is a plain copy since the canvas is empty there. origin
+// is where out sits on the canvas, for compose regions
+// -----------------------------------------------------------------------------
+int RadialStitcher::blendRect(cv::Mat& warped, cv::Mat& out, cv::Rect canvasRect,
+    cv::Mat& newMask, cv::Mat& prevMask, cv::Rect filled, int t, cv::Point origin){
+
+    cv::Rect overlap = canvasRect & filled;
+
+    if(overlap.area() <= 0){
+        warped.copyTo(out(canvasRect));
+        return 0;
+    }
+
+    // Overlap in tile coordinates
+    cv::Rect local = overlap - canvasRect.tl();
+    cv::Mat tileNew = warped(local);
+    cv::Mat tileNewMask = newMask(local);
+    cv::Mat tileCanvasMask = prevMask(local);
+    cv::Mat tileCanvas = out(overlap);
+    if(settings.blendMode == MULTIBAND){
+        if(blendMultiBand(tileNew, tileCanvas, tileNewMask, tileCanvasMask, overlap.tl() + origin)) return -1;
+    } else if(settings.blendMode == SEAM){
+        bool newOnRight = local.x == 0; // Wrapped tiles reach the first image from its left
+        if(blendSeam(tileNew, tileCanvas, tileNewMask, tileCanvasMask, newOnRight, t, overlap)) return -1;
+    } else if(blendFeather(tileNew, tileCanvas, tileNewMask, tileCanvasMask)){
+        return -1;
+    }
+
+    // Up to four bands of the tile around the overlap
+    int top = local.y;
+    int bottom = local.y + local.height;
+    int leftEdge = local.x;
+    int rightEdge = local.x + local.width;
+
+    cv::Rect bands[4] = {
+        cv::Rect(0, 0, canvasRect.width, top),
+        cv::Rect(0, bottom, canvasRect.width, canvasRect.height - bottom),
+        cv::Rect(0, top, leftEdge, local.height),
+        cv::Rect(rightEdge, top, canvasRect.width - rightEdge, local.height)
+    };
+
+    for (int b = 0; b < 4; b++) {
+        if(bands[b].area() <= 0) continue;
+        warped(bands[b]).copyTo(out(bands[b] + canvasRect.tl()));
+    }
+
+    return 0;
+
+}
+
+
+// Where image i lands in the canvas, translations snap to whole pixels
+// Returns false if image lies entirely off canvas, otherwise the clipped
+// canvas rectangle and the matching rectangle in the image. wrap shifts the
+// image by whole canvas widths, for the far side of a closed loop's seam
+// Transforms are in native pixels, src is already at output scale
+// -----------------------------------------------------------------------------
+bool RadialStitcher::placement(int i, cv::Rect& canvasRect, cv::Rect& imageRect, int wrap){
+
+    int x = cvRound(transforms[i].at<double>(0, 2) * outputScale) + wrap * outputSize.width;
+    int y = cvRound(transforms[i].at<double>(1, 2) * outputScale);
+    if(eye >= 0) x -= eyes[eye].offset; // Eye strip lands where the image center did
+
+    cv::Size size = scaledSize(frames[i].size(), outputScale); // Same as src once prewarped
+    cv::Rect placed(x, y, size.width, size.height);
+    canvasRect = placed & cv::Rect(0, 0, outputSize.width, outputSize.height);
+    if(eye >= 0) canvasRect &= eyes[eye].windows[i] + placed.tl();
+    if(canvasRect.area() <= 0) return false;
+
+    imageRect = canvasRect - placed.tl();
+
+    return true;
+
+}
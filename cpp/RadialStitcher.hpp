@@ -61,10 +61,19 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+#ifndef RADIAL_STITCHER_HPP
+#define RADIAL_STITCHER_HPP
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
 #include <vector>
 
 #include <opencv2/opencv.hpp>
 
+#include "Profiler.hpp"
+
 ////////////////////////////////////////////////////////////////////////////////
 
 
@@ -75,41 +84,317 @@ class RadialStitcher {
 
     public:
 
-        RadialStitcher(int numImages, char ** fileNames);
+        // Image prewarp options
+        enum Projection{ CYLINDRICAL, SPHERICAL };
+
+        // Descriptor matching options
+        enum Matcher{ BRUTE_FORCE, LSH }; // Hamming brute force or FLANN LSH index
+        enum MatchFilter{ RATIO_TEST, CROSS_CHECK };
+
+        // Translation estimate options
+        enum Estimator{ HISTOGRAM, RANSAC }; // Linear time voting or sampled consensus
+
+        // Compositing options
+        enum BlendMode{ FEATHER, FEATHER_REFERENCE, MULTIBAND, SEAM }; // SIMD feather, original double math, Laplacian pyramid, DP cut
+
+        // Exposure compensation options
+        enum Exposure{ EXPOSURE_NONE, EXPOSURE_GAIN, EXPOSURE_CHANNELS }; // Off, one gain per camera, one per color channel
+
+        // Tunable stitcher parameters, defaults match the LA skyline set
+        struct Settings {
+            double focalLength; // Prewarp focal length in pixels
+            Projection projection;
+            bool useWarpMaps; // Prewarp through cached lookup tables instead of per-pixel trig
+            bool bilinear; // Interpolate native scale prewarps too, resampling always does
+            bool overlapOnly; // Detect and match features in the expected overlap strips only
+            double overlapFraction; // Expected overlap between neighbors, fraction of image width
+            int matchScale; // Detect and match on images shrunk by this factor, refined at full size
+            int decodeScale; // readImages decodes at 1/N for previews, focalLength stays in full size pixels
+            Matcher matcher;
+            MatchFilter matchFilter;
+            double ratio; // Best match must be this much closer than the second best
+            double maxMatchTime; // Milliseconds of matching per frame set, 0 for no limit
+            Estimator estimator;
+            double confidence; // RANSAC stops once this sure of its best hypothesis
+            int minInliers; // Pairs with fewer agreeing matches fail to register
+            BlendMode blendMode;
+            int blendLevels; // Multi-band pyramid depth below full resolution
+            int blendBandRows; // Multi-band working height, bounds pyramid memory
+            int seamBand; // Seam mode feathers this many pixels either side of the cut
+            int seamWindow; // Video seams move at most this far per frame, 0 recuts each frame
+            int maskDepth; // Alpha mask storage, CV_8U, CV_16U or CV_64F
+            int numThreads; // Worker thread cap, applied once by the driver, 0 for OpenCV default
+            bool closeLoop; // Match last image back to first, 360 degree 2:1 canvas
+            int outputWidth; // Panorama width in pixels, folded into the warp, 0 for native
+            Exposure exposure;
+            int gainInterval; // Frame sets between gain updates in video
+            double gainSmoothing; // Weight of each update against the running gains
+            bool stereo; // Over-under left and right eye panoramas, left on top
+            double stereoOffset; // Eye strips are centered this fraction of the image width off center
+            int refreshInterval; // Video frame sets between full recomposes, in between only changed cells, 0 for off
+            double changeThreshold; // Mean absolute difference per sample that marks a source block changed
+            Settings();
+        };
+
+        RadialStitcher(int numImages, const Settings& settings = Settings()); // Frames handed in later with setImages
         ~RadialStitcher();
 
-        // Main stitching process
-        int Stitch();
+        // Main stitching process, registers unless calibrated and composes into
+        // panorama. No disk or window I/O, callers decide what to do with it
+        int Stitch(cv::Mat& panorama);
 
-        // Image prewarp options
-        enum Projection{ CYLINDRICAL, SPHERICAL };
+        // Receives the panorama top to bottom, y is the band's first canvas row.
+        // A nonzero return stops composition. Seams feather, stereo returns -1
+        typedef std::function<int(const cv::Mat& band, int y)> BandWriter;
+        int Stitch(const BandWriter& write, int bandRows); // Never holds the whole canvas
+
+        // Per-frame stitching, transforms are estimated once and then reused
+        int readImages(const char * const * fileNames); // Load numImages files as the frame set
+        int setImages(std::vector<cv::Mat>& images); // New frame set, prewarped when something needs it
+        int prewarp(); // Prewarp the current frame set now, e.g. before reading blend masks
+        int setImages(const std::vector<const uchar*>& data, cv::Size size, size_t step = 0); // BGR buffers
+        int estimateTransforms(); // Register prewarped images against each other
+        int compose(cv::Mat& out); // Warp and blend with current transforms, reuses out if sized
+        int compose(uchar* data, size_t step = 0); // Into a BGR buffer of getCanvasSize()
+        int composeBands(const BandWriter& write, int bandRows); // Warps each band straight from the frames
+        int measureGains(std::vector<cv::Mat>& images); // Prewarp and re-measure gains now, for other backends
+
+        // Calibration, freezes transforms so Stitch skips feature matching
+        int calibrate(); // Register the current frame set
+        int calibrate(std::vector<std::vector<cv::Mat> >& frameSets); // Average several sets
+        int saveCalibration(const std::string& fileName);
+        int loadCalibration(const std::string& fileName); // Call before prewarping
+        int scaleCalibration(cv::Size frameSize); // Same rig at another resolution
+        bool isCalibrated() const { return calibrated; }
+
+        // Matches agreeing with each estimated translation, index of right image
+        const std::vector<int>& getPairInliers() const { return pairInliers; }
+
+        // Buffers the stitcher had to (re)allocate, flat once frame sizes settle
+        int64 getAllocationCount() const { return allocations.load(); }
+        int64 getAllocatedBytes() const { return allocatedBytes.load(); }
+
+        // Stage timing and counters, off until opened
+        Profiler& getProfiler() { return profiler; }
+
+        // Prewarp settings take effect with the next setImages
+        const Settings& getSettings() const { return settings; }
+        void setSettings(const Settings& settings) { this->settings = settings; }
+
+        // Registered layout and prewarp tables, lets another compositing
+        // backend replay warp and blend without the images living here
+        int getNumImages() const { return numImages; }
+        cv::Size getCanvasSize() const { // At output scale, both eyes in stereo
+            return settings.stereo ? cv::Size(outputSize.width, 2 * outputSize.height) : outputSize;
+        }
+        cv::Size getImageSize() const { return imageSize; } // Input frames
+        const cv::Mat& getBlendMask(int i) const { return blendMasks[i]; } // Prewarped, settings.maskDepth
+        bool placement(int i, cv::Rect& canvasRect, cv::Rect& imageRect, int wrap = 0);
+        int getWarpMapFloat(cv::Size size, cv::Mat& mapX, cv::Mat& mapY, int& interpolation); // CV_32FC1 pair
+        const cv::Mat& getGainTable(int i) const { return gainTables[i]; } // 1x256 CV_8UC3, empty when off
+        cv::Vec3d getGain(int i) const { return gains[i]; } // B G R
+
+        // Piece of an image on the canvas. A closed loop splits images that
+        // cross the seam into one tile per side
+        struct Tile {
+            int image;
+            cv::Rect canvasRect; // Clipped to the canvas
+            cv::Rect imageRect; // Same pixels in the prewarped image
+        };
+
+        // Part of an earlier image's mask a tile feathers against
+        struct MaskPatch {
+            int image;
+            cv::Rect source; // In that image's mask
+            cv::Rect target; // In the tile
+        };
+
+        // Warp maps by geometry, thread safe. Stitchers of a batch share one so
+        // sets shot with the same rig reuse the maps. Holds the most recently
+        // used ones only, so a batch of many geometries stays bounded
+        struct WarpCache;
+        cv::Ptr<WarpCache> getWarpCache() const { return warpCache; }
+        void setWarpCache(const cv::Ptr<WarpCache>& cache) { warpCache = cache; }
+
+        // Forgets registration, gains and seams for an unrelated frame set,
+        // buffers and detectors are kept
+        void reset();
+
+        int getTiles(std::vector<Tile>& tiles); // In compositing order
+        int getMaskPatches(const std::vector<Tile>& tiles, int t, std::vector<MaskPatch>& patches);
 
 
     private:
 
         // Stitcher Parameters
         int numImages;
-        double focalLength;
-        Projection projection;
+        Settings settings;
+
+        // Inverse prewarp mapping, shared by an image and its blend mask
+        struct WarpMap {
+            cv::Mat map1; // Source coordinates, CV_16SC2 or CV_32FC1 for x
+            cv::Mat map2; // CV_16UC1 sub-pixel table or empty for CV_16SC2, CV_32FC1 for y otherwise
+            cv::Size srcSize; // Frames the map samples, map1 is output size
+            int interpolation; // Nearest at native scale unless settings.bilinear, bilinear when resampling
+        };
+
+        // Warp maps only depend on image geometry, so key them on it
+        struct WarpKey {
+            int cols;
+            int rows;
+            double focalLength;
+            double scale;
+            Projection projection;
+            bool bilinear; // Resampling maps always are
+            bool operator<(const WarpKey& other) const;
+        };
+
+        cv::Ptr<WarpCache> warpCache; // Built on first use, reused until evicted
 
         // Images and Masks
-        std::vector<cv::Mat> src; // Stores input images
+        std::vector<cv::Mat> frames; // Current input frames, shared with the caller
+        std::vector<cv::Mat> decoded; // readImages buffers, reused by the next set
+        std::vector<cv::Mat> src; // Stores prewarped images
         std::vector<cv::Mat> blendMasks; // Store alpha channel blend masks for images in src
         std::vector<cv::Mat> transforms; // Translation matrices for all images rel. to 1st
+        cv::Size canvasSize; // Mosaic size at native scale, set along with transforms
+        cv::Size outputSize; // Mosaic size at output scale
+        double outputScale; // settings.outputWidth over native canvas width
+        double srcScale; // Scale src and blendMasks were last prewarped at
+        cv::Size imageSize; // Input frame size transforms were estimated for
+        bool calibrated; // Transforms frozen from a calibration
+
+        // Feature point information, computed once per image
+        struct Features {
+            std::vector<cv::KeyPoint> keypoints; // In pixels of the image detected on
+            cv::Mat descriptors;
+            int cols; // Width of that image
+            double scale; // Its size relative to src
+        };
+
+        std::vector<Features> features; // One entry per image in src
+        std::vector<std::vector<cv::DMatch> > matches; // matches[i] pairs image i (query) with i - 1 (train)
+        int64 matchBudget; // Ticks of matching each pair may spend, 0 for no limit
+        std::vector<int> pairInliers; // pairInliers[i] for pair of image i and i - 1
+        std::vector<cv::Ptr<cv::ORB> > detectors; // One per image so detection runs in parallel
+        std::vector<cv::Mat> coarse; // src shrunk by settings.matchScale for detection
+        cv::Mat refineA, refineB, refineWindow; // Phase correlation patches, CV_32FC1
+
+        // Scratch kept across frames so steady state stitching allocates nothing
+        std::atomic<int64> allocations; // Buffers created by reserveBuffer, from parallel loops too
+        std::atomic<int64> allocatedBytes; // Their total size
+        Profiler profiler;
+        std::vector<int> prewarpStatus;
+        std::vector<Tile> tiles;
+        std::vector<MaskPatch> patches;
+        std::vector<cv::Mat> tileMasks; // Neighbor masks under each tile
+        std::vector<ushort> featherScratch; // One row of blend weights
 
-        // Feature point information, rewritten over course of stitching
-        std::vector<cv::KeyPoint> keypoints1; // curr image keypoints
-        std::vector<cv::KeyPoint> keypoints2; // neighbor image keypoints
-        std::vector<cv::DMatch> matches; // feature pairs
+        // Multi-band working set for one row band of an overlap tile
+        cv::Mat bandCanvas; // Canvas rows as they were before this band
+        cv::Mat bandCarry; // Original rows the next band needs above it
+        cv::Mat baseNew, baseCanvas, baseMask; // Base level before padding out to the canvas grid
+        std::vector<cv::Mat> pyramidNew, pyramidCanvas, pyramidMask; // Gaussian, CV_32F
+        std::vector<cv::Mat> pyramidUpNew, pyramidUpCanvas, pyramidUpOut; // Next coarser level expanded
+        std::vector<cv::Mat> pyramidOut; // Blended and collapsed up to each level
+
+        // Seam mode, last cut through each tile's overlap
+        struct Seam {
+            cv::Rect overlap; // Canvas area the cut was made in
+            std::vector<int> columns; // Seam column of every overlap row
+        };
+
+        std::vector<Seam> seams; // Indexed like tiles
+
+        // Stereo eyes, 0 left and 1 right. Each composes a strip from either
+        // side of every prewarped image, everything up to the blend is shared
+        struct Eye {
+            int offset; // Strip center right of image center, output pixels
+            std::vector<cv::Rect> windows; // Strip of each image, image coordinates
+            std::vector<cv::Mat> masks; // Blend masks cut to the strip, feathered at its edges
+            std::vector<Seam> seams;
+        };
+
+        Eye eyes[2];
+        int eye; // Being composed, -1 for mono
+
+        // Incremental video. Between full refreshes frames are only compared
+        // to the previous set, and canvas cells sampling a changed block are
+        // recomposed into the kept canvas
+        static const int changeBlock = 32; // Source pixels per side compared as one
+        static const int changeCell = 64; // Canvas pixels per side recomposed as one
+        std::vector<cv::Mat> previousFrames;
+        std::vector<cv::Mat> changedBlocks; // Integral of changed block flags per camera, CV_32S
+        std::vector<std::vector<cv::Rect> > cellSources; // Per tile and cell, frame pixels it samples
+        cv::Mat persistentCanvas; // Last composed panorama
+        cv::Mat cellDirty; // Per cell, CV_8U
+        int framesSinceRefresh;
+        bool tracking; // Frames since the last full compose were only compared
+        bool srcStale; // Frames changed since src and blendMasks were prewarped
+
+        cv::Mat seamCost; // Accumulated DP cost, CV_32SC1
+        std::vector<cv::Range> seamRange; // Searched columns of each row
+
+        // Exposure compensation, folded into the prewarp gather
+        std::vector<cv::Vec3d> gains; // Per image B G R, applied to src
+        std::vector<cv::Mat> gainTables; // Gains as lookup tables, empty until estimated
+        int framesSinceGains; // Frame sets prewarped since the last update
+
+        // Banded compositing, only ever one band of canvas and warped rows
+        std::vector<cv::Mat> sourceMasks; // Unprojected blend masks, one per frame size
+        cv::Mat bandOut; // Band plus multi-band margin
+        cv::Mat regionImage, regionMask, regionPatch; // Rows of one tile warped for a band
 
         // Auxiliary functions
+        void init(int numImages, const Settings& settings);
+        void reserveBuffer(cv::Mat& buffer, cv::Size size, int type);
+        bool closedLoop() const { return settings.closeLoop && numImages > 2; }
+        double prewarpScale() const { return (int) transforms.size() == numImages ? outputScale : 1.0; }
+        int prewarpFrames(double scale);
+        int prewarpImage(int i, cv::Mat& temp, double scale);
+        int finishRegistration();
+        int fitCanvas();
+        void updateOutputScale();
         int buildBlendMask(cv::Mat& img, cv::Mat& mask);
-        int projectCylindrical(cv::Mat &I, cv::Mat&O, double focalLength);
-        int projectSpherical(cv::Mat &I, cv::Mat&O, double focalLength);
-        int projectMaskSpherical(cv::Mat &I, cv::Mat&O, double focalLength);
-        int projectMaskCylindrical(cv::Mat &I, cv::Mat&O, double focalLength);
+        int project(cv::Mat &I, cv::Mat&O, double focalLength, Projection projection, bool bilinear);
+        cv::Ptr<const WarpMap> getWarpMap(cv::Size size, double focalLength, Projection projection, double scale);
+        int buildWarpMap(cv::Size size, double focalLength, Projection projection, double scale,
+            bool bilinear, WarpMap& map);
+        int projectWithMap(cv::Mat &I, cv::Mat&O, const WarpMap& map);
+        int projectWithGain(cv::Mat &I, cv::Mat&O, const WarpMap& map, const cv::Mat& table);
+        int projectRows(cv::Mat &I, cv::Mat&O, const WarpMap& map, cv::Rect rows, const cv::Mat& table);
+        int composeRegion(cv::Rect region, cv::Mat& out);
+        int composeView(cv::Mat& out); // Mono, or the current eye
+        int prepareRegions();
+        bool canTrack(const std::vector<cv::Mat>& images) const;
+        int trackChanges();
+        int keepCanvas(const cv::Mat& out);
+        int composeChanged(cv::Mat& out);
+        int updateEyes();
+        bool gainsActive() const { return settings.exposure != EXPOSURE_NONE && !gainTables[0].empty(); }
+        int updateGains();
+        int estimateGains(double smoothing);
         int blend(cv::Mat& newImage, cv::Mat& canvas, cv::Mat& newMask, cv::Mat& canvasMask);
-        int estimateHomography(cv::Mat& homography);
-        int getFeatures(cv::Mat& img1, cv::Mat& img2);
+        int blendFeather(cv::Mat& newImage, cv::Mat& canvas, cv::Mat& newMask, cv::Mat& canvasMask);
+        int blendMultiBand(cv::Mat& newImage, cv::Mat& canvas, cv::Mat& newMask, cv::Mat& canvasMask,
+            cv::Point origin); // Canvas position of the overlap, pyramids align to it
+        int blendRect(cv::Mat& warped, cv::Mat& out, cv::Rect canvasRect,
+            cv::Mat& newMask, cv::Mat& prevMask, cv::Rect filled, int t, cv::Point origin = cv::Point());
+        int blendSeam(cv::Mat& newImage, cv::Mat& canvas, cv::Mat& newMask, cv::Mat& canvasMask,
+            bool newOnRight, int t, cv::Rect overlap);
+        int estimateHomography(int curr, int left, cv::Mat& homography);
+        int refineTranslation(int curr, int left, cv::Mat& homography);
+        int distributeDrift(std::vector<cv::Point2d>& shifts, int circumference);
+        int voteTranslation(const std::vector<cv::Point2d>& shifts, double& xTrans, double& yTrans);
+        int ransacTranslation(const std::vector<cv::Point2d>& shifts, double& xTrans, double& yTrans);
+        int detectFeatures(); // All images, in parallel
+        int detectFeatures(int i);
+        int matchFeatures(int curr, int left);
+        int selectStrip(int i, int x0, int x1, cv::Mat& descriptors, std::vector<int>& index);
+        cv::Ptr<cv::DescriptorMatcher> createMatcher();
+        int matchRows(cv::DescriptorMatcher& matcher, const cv::Mat& query, const cv::Mat& train,
+            int k, int64 deadline, std::vector<std::vector<cv::DMatch> >& knn);
 
 };
+
+#endif
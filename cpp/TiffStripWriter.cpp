@@ -0,0 +1,256 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Standard
+#include <climits>
+#include <iostream>
+
+// OpenCV 3.1.0
+#include <opencv2/opencv.hpp>
+
+// Radial Stitcher
+#include "TiffStripWriter.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// TIFF field types
+static const unsigned int TIFF_SHORT = 3;
+static const unsigned int TIFF_LONG = 4;
+static const unsigned int TIFF_RATIONAL = 5;
+
+
+TiffStripWriter::TiffStripWriter(){
+
+    rowsPerStrip = 0;
+    rowsWritten = 0;
+
+}
+
+
+TiffStripWriter::~TiffStripWriter(){
+
+    if(file.is_open()) file.close(); // Unfinished file has no directory
+
+}
+
+
+// Writes the header, the directory offset is filled in by close
+// -----------------------------------------------------------------------------
+int TiffStripWriter::open(const std::string& fileName, cv::Size size, int rowsPerStrip){
+
+    if(size.area() <= 0 || rowsPerStrip < 1) return -1;
+
+    file.open(fileName.c_str(), std::ios::binary | std::ios::trunc);
+    if(!file.is_open()){
+        std::cout << "Image " << fileName << " could not be written." << std::endl;
+        return -1;
+    }
+
+    this->size = size;
+    this->rowsPerStrip = rowsPerStrip;
+    rowsWritten = 0;
+    stripOffsets.clear();
+    stripByteCounts.clear();
+    row.resize(3 * size.width);
+
+    file.write("II", 2); // Little endian
+    writeShort(42);
+    writeLong(0);
+
+    return file.good() ? 0 : -1;
+
+}
+
+
+// Appends one strip, swapping BGR to RGB a row at a time
+// -----------------------------------------------------------------------------
+int TiffStripWriter::writeStrip(const cv::Mat& strip){
+
+    if(!file.is_open() || strip.type() != CV_8UC3 || strip.cols != size.width) return -1;
+
+    int remaining = size.height - rowsWritten;
+    if(strip.rows != std::min(rowsPerStrip, remaining)) return -1; // Not the next strip
+
+    double offset = (double) file.tellp();
+    double bytes = (double) row.size() * strip.rows;
+    if(offset + bytes > UINT_MAX){
+        std::cout << "Panorama too large for a classic TIFF." << std::endl;
+        return -1;
+    }
+
+    stripOffsets.push_back((unsigned int) offset);
+    stripByteCounts.push_back((unsigned int) bytes);
+
+    for (int y = 0; y < strip.rows; y++) {
+        const uchar* bgr = strip.ptr<uchar>(y);
+        for (int x = 0; x < size.width; x++) {
+            row[3*x] = bgr[3*x + 2];
+            row[3*x + 1] = bgr[3*x + 1];
+            row[3*x + 2] = bgr[3*x];
+        }
+        file.write((const char*) &row[0], row.size());
+    }
+
+    rowsWritten += strip.rows;
+
+    return file.good() ? 0 : -1;
+
+}
+
+
+// Writes the image directory after the strips and points the header at it
+// -----------------------------------------------------------------------------
+int TiffStripWriter::close(){
+
+    if(!file.is_open()) return -1;
+
+    if(rowsWritten != size.height){
+        file.close();
+        return -1;
+    }
+
+    if(file.tellp() % 2) file.put(0); // Directory starts on a word boundary
+
+    const unsigned int numEntries = 13;
+    unsigned int numStrips = (unsigned int) stripOffsets.size();
+    unsigned int directory = (unsigned int) file.tellp();
+
+    // Values too big for an entry follow the directory
+    unsigned int bitsOffset = directory + 2 + numEntries * 12 + 4;
+    unsigned int offsetsOffset = bitsOffset + 8;
+    unsigned int countsOffset = offsetsOffset + 4 * numStrips;
+    unsigned int resolutionOffset = countsOffset + 4 * numStrips;
+
+    // Entries in ascending tag order
+    writeShort(numEntries);
+    writeEntry(256, TIFF_LONG, 1, size.width); // ImageWidth
+    writeEntry(257, TIFF_LONG, 1, size.height); // ImageLength
+    writeEntry(258, TIFF_SHORT, 3, bitsOffset); // BitsPerSample
+    writeEntry(259, TIFF_SHORT, 1, 1); // Compression, none
+    writeEntry(262, TIFF_SHORT, 1, 2); // PhotometricInterpretation, RGB
+    writeEntry(273, TIFF_LONG, numStrips, numStrips == 1 ? stripOffsets[0] : offsetsOffset); // StripOffsets
+    writeEntry(277, TIFF_SHORT, 1, 3); // SamplesPerPixel
+    writeEntry(278, TIFF_LONG, 1, rowsPerStrip); // RowsPerStrip
+    writeEntry(279, TIFF_LONG, numStrips, numStrips == 1 ? stripByteCounts[0] : countsOffset); // StripByteCounts
+    writeEntry(282, TIFF_RATIONAL, 1, resolutionOffset); // XResolution
+    writeEntry(283, TIFF_RATIONAL, 1, resolutionOffset + 8); // YResolution
+    writeEntry(284, TIFF_SHORT, 1, 1); // PlanarConfiguration, interleaved
+    writeEntry(296, TIFF_SHORT, 1, 2); // ResolutionUnit, inch
+    writeLong(0); // No further images
+
+    for (int c = 0; c < 3; c++) writeShort(8);
+    writeShort(0); // Pad to the strip offsets
+
+    for (unsigned int s = 0; s < numStrips; s++) writeLong(stripOffsets[s]);
+    for (unsigned int s = 0; s < numStrips; s++) writeLong(stripByteCounts[s]);
+
+    for (int r = 0; r < 2; r++) { // 72 dpi
+        writeLong(72);
+        writeLong(1);
+    }
+
+    file.seekp(4);
+    writeLong(directory);
+
+    bool good = file.good();
+    file.close();
+
+    return good ? 0 : -1;
+
+}
+
+
+void TiffStripWriter::writeShort(unsigned int value){
+
+    char bytes[2] = { (char) (value & 0xFF), (char) ((value >> 8) & 0xFF) };
+    file.write(bytes, 2);
+
+}
+
+
+void TiffStripWriter::writeLong(unsigned int value){
+
+    char bytes[4] = { (char) (value & 0xFF), (char) ((value >> 8) & 0xFF),
+        (char) ((value >> 16) & 0xFF), (char) ((value >> 24) & 0xFF) };
+    file.write(bytes, 4);
+
+}
+
+
+// One directory entry, a single SHORT sits in the low half of the value field
+// -----------------------------------------------------------------------------
+void TiffStripWriter::writeEntry(unsigned int tag, unsigned int type, unsigned int count, unsigned int value){
+
+    writeShort(tag);
+    writeShort(type);
+    writeLong(count);
+
+    if(type == TIFF_SHORT && count == 1){
+        writeShort(value);
+        writeShort(0);
+    } else {
+        writeLong(value);
+    }
+
+}
@@ -0,0 +1,111 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TIFF_STRIP_WRITER_HPP
+#define TIFF_STRIP_WRITER_HPP
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Writes a baseline, uncompressed RGB TIFF one strip at a time, so a panorama
+// can be encoded as it is composed without ever being whole in memory. Strips
+// go to disk as they arrive, the directory is written at the end. Classic
+// TIFF offsets are 32 bit, which caps files at 4 GB (about 1.4 gigapixels)
+// -----------------------------------------------------------------------------
+class TiffStripWriter {
+
+    public:
+
+        TiffStripWriter();
+        ~TiffStripWriter();
+
+        // Every strip but the last must be rowsPerStrip rows
+        int open(const std::string& fileName, cv::Size size, int rowsPerStrip);
+        int writeStrip(const cv::Mat& strip); // BGR, CV_8UC3, top to bottom
+        int close(); // Writes the directory, fails if rows are missing
+        bool isOpen() const { return file.is_open(); }
+
+    private:
+
+        std::ofstream file;
+        cv::Size size;
+        int rowsPerStrip;
+        int rowsWritten;
+        std::vector<unsigned int> stripOffsets;
+        std::vector<unsigned int> stripByteCounts;
+        std::vector<uchar> row; // One row as RGB
+
+        // Auxiliary functions
+        void writeShort(unsigned int value);
+        void writeLong(unsigned int value);
+        void writeEntry(unsigned int tag, unsigned int type, unsigned int count, unsigned int value);
+
+};
+
+#endif
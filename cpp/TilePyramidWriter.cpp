@@ -0,0 +1,254 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Standard
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+
+// OpenCV 3.1.0
+#include <opencv2/opencv.hpp>
+
+// Radial Stitcher
+#include "TilePyramidWriter.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+TilePyramidWriter::TilePyramidWriter(){
+
+    tileSize = 0;
+    quality = 85;
+    rowsWritten = 0;
+
+}
+
+
+TilePyramidWriter::~TilePyramidWriter(){}
+
+
+// Sizes every level and makes their directories. Tile size must be even so
+// halved strips line up with the next level's tile rows
+// -----------------------------------------------------------------------------
+int TilePyramidWriter::open(const std::string& dir, cv::Size size, int tileSize, int quality){
+
+    if(size.width <= 0 || size.height <= 0 || tileSize < 2 || tileSize % 2) return -1;
+
+    this->dir = dir;
+    this->size = size;
+    this->tileSize = tileSize;
+    this->quality = quality;
+    rowsWritten = 0;
+
+    levels.clear();
+    cv::Size levelSize = size;
+    while (true) {
+        Level level;
+        level.size = levelSize;
+        level.filled = 0;
+        level.tileRow = 0;
+        levels.push_back(level);
+        if(levelSize.width <= tileSize && levelSize.height <= tileSize) break;
+        levelSize = cv::Size((levelSize.width + 1) / 2, (levelSize.height + 1) / 2);
+    }
+
+    mkdir(dir.c_str(), 0755); // Fine if it already exists
+    for (int l = 0; l < (int) levels.size(); l++) {
+        std::stringstream levelDir;
+        levelDir << dir << "/" << levels.size() - 1 - l;
+        mkdir(levelDir.str().c_str(), 0755);
+    }
+
+    for (int l = 0; l < (int) levels.size(); l++) {
+        levels[l].strip.create(tileSize, levels[l].size.width, CV_8UC3);
+    }
+
+    return 0;
+
+}
+
+
+// Next rows of the full size panorama
+// -----------------------------------------------------------------------------
+int TilePyramidWriter::writeBand(const cv::Mat& band){
+
+    if(levels.empty() || band.type() != CV_8UC3 || band.cols != size.width) return -1;
+    if(rowsWritten + band.rows > size.height) return -1;
+
+    rowsWritten += band.rows;
+    return addRows(0, band);
+
+}
+
+
+// Copies rows into level l's strip, writing it out each time it fills
+// -----------------------------------------------------------------------------
+int TilePyramidWriter::addRows(int l, const cv::Mat& rows){
+
+    Level& level = levels[l];
+
+    int y = 0;
+    while (y < rows.rows) {
+
+        int n = std::min(rows.rows - y, tileSize - level.filled);
+        rows.rowRange(y, y + n).copyTo(level.strip.rowRange(level.filled, level.filled + n));
+        level.filled += n;
+        y += n;
+
+        if(level.filled == tileSize && flushStrip(l)) return -1;
+
+    }
+
+    return 0;
+
+}
+
+
+// Writes the filled part of level l's strip as a row of tiles, then passes it
+// on halved. Partial strips only happen at the bottom of a level
+// -----------------------------------------------------------------------------
+int TilePyramidWriter::flushStrip(int l){
+
+    Level& level = levels[l];
+    if(level.filled == 0) return 0;
+
+    cv::Mat filled = level.strip.rowRange(0, level.filled);
+    int z = (int) levels.size() - 1 - l;
+
+    std::vector<int> params;
+    params.push_back(cv::IMWRITE_JPEG_QUALITY);
+    params.push_back(quality);
+
+    for (int x = 0, column = 0; x < level.size.width; x += tileSize, column++) {
+
+        cv::Mat tile = filled.colRange(x, std::min(x + tileSize, level.size.width));
+
+        std::stringstream name;
+        name << dir << "/" << z << "/" << level.tileRow << "_" << column << ".jpg";
+        if(!cv::imwrite(name.str(), tile, params)){
+            std::cout << "Tile " << name.str() << " could not be written." << std::endl;
+            return -1;
+        }
+
+    }
+
+    // Area averaging is an exact 2x2 box where sizes are even
+    if(l + 1 < (int) levels.size()){
+        cv::Mat halved;
+        cv::resize(filled, halved, cv::Size(levels[l + 1].size.width, (level.filled + 1) / 2), 0, 0, cv::INTER_AREA);
+        if(addRows(l + 1, halved)) return -1;
+    }
+
+    level.filled = 0;
+    level.tileRow++;
+
+    return 0;
+
+}
+
+
+// Tile grid of every level, coarsest first, for the viewer
+// -----------------------------------------------------------------------------
+int TilePyramidWriter::writeManifest(){
+
+    std::ofstream manifest((dir + "/manifest.json").c_str());
+    if(!manifest.is_open()) return -1;
+
+    manifest << "{\"projection\": \"equirectangular\", \"format\": \"jpg\", \"tileSize\": " << tileSize
+        << ", \"width\": " << size.width << ", \"height\": " << size.height << ", \"levels\": [";
+
+    for (int z = 0; z < (int) levels.size(); z++) {
+        const Level& level = levels[levels.size() - 1 - z];
+        if(z) manifest << ", ";
+        manifest << "{\"width\": " << level.size.width << ", \"height\": " << level.size.height
+            << ", \"columns\": " << (level.size.width + tileSize - 1) / tileSize
+            << ", \"rows\": " << (level.size.height + tileSize - 1) / tileSize << "}";
+    }
+
+    manifest << "]}" << std::endl;
+
+    return manifest.good() ? 0 : -1;
+
+}
+
+
+// Flushes every level top down, so halved leftovers reach the coarser ones
+// before those are flushed
+// -----------------------------------------------------------------------------
+int TilePyramidWriter::close(){
+
+    if(levels.empty()) return -1;
+
+    int status = rowsWritten == size.height ? 0 : -1;
+    if(status) std::cout << "Tile pyramid is missing " << size.height - rowsWritten << " rows." << std::endl;
+
+    for (int l = 0; !status && l < (int) levels.size(); l++) status = flushStrip(l);
+    if(!status) status = writeManifest();
+
+    levels.clear();
+
+    return status;
+
+}
@@ -0,0 +1,118 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TILE_PYRAMID_WRITER_HPP
+#define TILE_PYRAMID_WRITER_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Cuts a panorama into a multi-resolution pyramid of JPEG tiles as it is
+// composed, for viewers that only fetch the tiles in view. Every level halves
+// the one above, down to a level that fits in one tile. Levels are built from
+// the bands as they arrive: each keeps one row of tiles, which is written out
+// and averaged 2x2 into the next level once full, so memory is a tile row per
+// level whatever the panorama size. Tiles are <dir>/<level>/<row>_<column>.jpg,
+// level 0 coarsest, described by <dir>/manifest.json
+// -----------------------------------------------------------------------------
+class TilePyramidWriter {
+
+    public:
+
+        TilePyramidWriter();
+        ~TilePyramidWriter();
+
+        int open(const std::string& dir, cv::Size size, int tileSize = 512, int quality = 85);
+        int writeBand(const cv::Mat& band); // BGR, CV_8UC3, top to bottom, any height
+        int close(); // Flushes the last rows and writes the manifest
+        bool isOpen() const { return !levels.empty(); }
+
+    private:
+
+        struct Level {
+            cv::Size size;
+            cv::Mat strip; // One row of tiles being filled
+            int filled; // Rows of strip filled
+            int tileRow; // Row of tiles strip becomes
+        };
+
+        std::string dir;
+        cv::Size size;
+        int tileSize;
+        int quality;
+        std::vector<Level> levels; // Finest first
+        int rowsWritten;
+
+        // Auxiliary functions
+        int addRows(int l, const cv::Mat& rows);
+        int flushStrip(int l);
+        int writeManifest();
+
+};
+
+#endif
@@ -0,0 +1,380 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Standard
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+// OpenCV 3.1.0
+#include <opencv2/opencv.hpp>
+
+// Radial Stitcher
+#include "VideoStitcher.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+const size_t VideoStitcher::queueDepth;
+
+
+// Initialize pipeline parameters, inputs are opened when the pipeline runs
+VideoStitcher::VideoStitcher(int numInputs, char ** inputNames, const char * outputName,
+    const RadialStitcher::Settings& settings)
+    : stitcher(numInputs, settings), encodeQueue(queueDepth), recycleQueue(queueDepth + 2) {
+
+    this->numInputs = numInputs;
+    this->outputName = outputName;
+    fps = 30;
+    useGpu = false;
+    gpuFramesSinceGains = 0;
+
+    for (int i = 0; i < numInputs; i++) {
+        this->inputNames.push_back(inputNames[i]);
+        decodeQueues.push_back(cv::makePtr<FrameQueue<cv::Mat> >(queueDepth));
+    }
+
+}
+
+
+VideoStitcher::~VideoStitcher(){}
+
+
+// Opens every input stream, all digit names are treated as capture devices
+// -----------------------------------------------------------------------------
+int VideoStitcher::openInputs(){
+
+    captures.clear();
+
+    for (int i = 0; i < numInputs; i++) {
+
+        const std::string& name = inputNames[i];
+
+        bool isDevice = !name.empty();
+        for (size_t c = 0; c < name.size(); c++) {
+            if(!isdigit(name[c])) isDevice = false;
+        }
+
+        cv::Ptr<cv::VideoCapture> capture = cv::makePtr<cv::VideoCapture>();
+        if(isDevice) capture->open(atoi(name.c_str()));
+        else capture->open(name);
+
+        if(!capture->isOpened()){
+            std::cout << "Video " << name << " could not be opened." << std::endl;
+            return -1;
+        }
+
+        captures.push_back(capture);
+
+    }
+
+    // Output runs at the rate of the first camera, rig is genlocked
+    double inputFps = captures[0]->get(cv::CAP_PROP_FPS);
+    if(inputFps > 0) fps = inputFps;
+
+    return 0;
+
+}
+
+
+// Reads frame sets from the start of the clip to calibrate the rig, then
+// rewinds file inputs so the whole clip gets stitched
+// -----------------------------------------------------------------------------
+int VideoStitcher::Calibrate(const std::string& fileName, int numSets){
+
+    if(openInputs()) return -1;
+
+    int frameStride = std::max(1, (int) fps); // One set per second of footage
+    std::vector<std::vector<cv::Mat> > frameSets;
+
+    for (int s = 0; s < numSets; s++) {
+
+        std::vector<cv::Mat> frames(numInputs);
+        bool endOfStream = false;
+
+        for (int i = 0; i < numInputs; i++) {
+            for (int skip = 0; s > 0 && skip < frameStride - 1; skip++) captures[i]->grab();
+            if(!captures[i]->read(frames[i])) endOfStream = true;
+        }
+
+        if(endOfStream) break;
+        frameSets.push_back(frames);
+
+    }
+
+    std::cout << "Calibrating on " << frameSets.size() << " frame sets..." << std::endl;
+
+    if(stitcher.calibrate(frameSets)) return -1;
+    if(stitcher.saveCalibration(fileName)) return -1;
+
+    for (int i = 0; i < numInputs; i++) captures[i]->set(cv::CAP_PROP_POS_FRAMES, 0);
+
+    return 0;
+
+}
+
+
+int VideoStitcher::loadCalibration(const std::string& fileName){
+
+    return stitcher.loadCalibration(fileName);
+
+}
+
+
+// GPU backend is only there when built with RADSTITCH_WITH_CUDA
+// -----------------------------------------------------------------------------
+int VideoStitcher::setUseGpu(bool useGpu){
+
+#ifdef RADSTITCH_WITH_CUDA
+    if(useGpu && !GpuStitcher::isAvailable()){
+        std::cout << "No CUDA device available." << std::endl;
+        return -1;
+    }
+    this->useGpu = useGpu;
+    return 0;
+#else
+    if(!useGpu) return 0;
+    std::cout << "Built without RADSTITCH_WITH_CUDA, GPU backend unavailable." << std::endl;
+    return -1;
+#endif
+
+}
+
+
+// Decode stage, one thread per camera
+// -----------------------------------------------------------------------------
+void VideoStitcher::decode(int input){
+
+    cv::Mat frame;
+
+    while (captures[input]->read(frame)) {
+        if(!decodeQueues[input]->push(frame)) break; // Pipeline shutting down
+        frame.release(); // Queued frame keeps its buffer, decode into a new one
+    }
+
+    decodeQueues[input]->close(); // End of stream
+
+}
+
+
+// Encode stage, writes H.264 so browsers can play the output in the viewer
+// -----------------------------------------------------------------------------
+void VideoStitcher::encode(){
+
+    cv::VideoWriter writer;
+    cv::Mat panorama;
+    Profiler& profiler = stitcher.getProfiler();
+
+    while (encodeQueue.pop(panorama)) {
+
+        Profiler::Mark start = profiler.mark();
+
+        if(!writer.isOpened()){
+
+            // Canvas size is only known once the first frame set is registered
+            writer.open(outputName, cv::VideoWriter::fourcc('a', 'v', 'c', '1'), fps, panorama.size());
+
+            if(!writer.isOpened()){
+                std::cout << "H.264 unavailable, falling back to MPEG-4." << std::endl;
+                writer.open(outputName, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, panorama.size());
+            }
+
+            if(!writer.isOpened()){
+                std::cout << "Video " << outputName << " could not be written." << std::endl;
+                encodeQueue.close(); // Stops the stitch stage
+                break;
+            }
+        }
+
+        writer.write(panorama);
+        profiler.stage("encode", start);
+        recycleQueue.tryPush(panorama); // Stitcher composes the next frame into it
+        panorama.release();
+
+    }
+
+    writer.release();
+
+}
+
+
+// Warps and blends one frame set. Without a calibration the first set is
+// registered on the CPU, after that the GPU backend takes raw frames directly
+// -----------------------------------------------------------------------------
+int VideoStitcher::stitchFrame(std::vector<cv::Mat>& frames, int index, cv::Mat& panorama){
+
+#ifdef RADSTITCH_WITH_CUDA
+    if(useGpu && gpu.isReady()){
+
+        // Every gainInterval sets one is prewarped on the CPU to follow
+        // exposure, the device picks the smoothed tables up from there
+        const RadialStitcher::Settings& settings = stitcher.getSettings();
+        if(settings.exposure != RadialStitcher::EXPOSURE_NONE &&
+            ++gpuFramesSinceGains >= std::max(1, settings.gainInterval)){
+            gpuFramesSinceGains = 0;
+            if(stitcher.measureGains(frames) || gpu.setGains(stitcher)){
+                std::cout << "Frame " << index << " gains could not be updated." << std::endl;
+                return -1;
+            }
+        }
+
+        Profiler::Mark start = stitcher.getProfiler().mark();
+        int status = gpu.stitch(frames, panorama);
+        stitcher.getProfiler().stage("blend", start, -1, "gpu", 1);
+        return status;
+    }
+#endif
+
+    if(stitcher.setImages(frames)){
+        std::cout << "Frame " << index << " could not be prewarped." << std::endl;
+        return -1;
+    }
+
+    if(index == 0 && !stitcher.isCalibrated() && stitcher.estimateTransforms()){
+        std::cout << "Could not register first frame set." << std::endl;
+        return -1;
+    }
+
+#ifdef RADSTITCH_WITH_CUDA
+    if(useGpu){
+        if(gpu.init(stitcher)) return -1;
+        gpuFramesSinceGains = 0;
+        return gpu.stitch(frames, panorama);
+    }
+#endif
+
+    return stitcher.compose(panorama);
+
+}
+
+
+// Runs decode -> warp -> blend -> encode, stitching stage runs on this thread
+// Without a calibration, transforms are estimated on the first frame set and
+// reused afterward
+// -----------------------------------------------------------------------------
+int VideoStitcher::Run(){
+
+    if(captures.empty() && openInputs()) return -1;
+
+    std::cout << "Stitching " << numInputs << " videos..." << std::endl;
+
+    std::vector<std::thread> decoders;
+    for (int i = 0; i < numInputs; i++) {
+        decoders.push_back(std::thread(&VideoStitcher::decode, this, i));
+    }
+    std::thread encoder(&VideoStitcher::encode, this);
+
+    int status = 0;
+    int numFrames = 0;
+    int64 start = cv::getTickCount();
+
+    std::vector<cv::Mat> frames(numInputs);
+    Profiler& profiler = stitcher.getProfiler();
+
+    while (true) {
+
+        // Wait for one frame from every camera
+        bool endOfStream = false;
+        for (int i = 0; i < numInputs; i++) {
+            if(!decodeQueues[i]->pop(frames[i])) endOfStream = true;
+        }
+        if(endOfStream) break;
+
+        // Reuse an encoded panorama when one is back, buffers in flight are
+        // bounded by the queue depth so this settles to no allocations
+        cv::Mat panorama;
+        recycleQueue.tryPop(panorama);
+        Profiler::Mark frameStart = profiler.mark();
+        if(stitchFrame(frames, numFrames, panorama)){
+            status = -1;
+            break;
+        }
+        profiler.frame(numFrames, frameStart, stitcher.getAllocationCount(), stitcher.getAllocatedBytes());
+
+        if(!encodeQueue.push(panorama)){ // Encoder gave up
+            status = -1;
+            break;
+        }
+
+        numFrames++;
+
+    }
+
+    // Drain and stop every stage
+    for (int i = 0; i < numInputs; i++) decodeQueues[i]->close();
+    encodeQueue.close();
+
+    for (int i = 0; i < numInputs; i++) decoders[i].join();
+    encoder.join();
+
+    double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+    std::cout << numFrames << " frames stitched in " << seconds << " s";
+    if(seconds > 0) std::cout << " (" << numFrames / seconds << " fps)";
+    std::cout << ", " << stitcher.getAllocationCount() << " stitcher buffer allocations" << std::endl;
+    profiler.summary();
+
+    return status;
+
+}
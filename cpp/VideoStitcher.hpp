@@ -0,0 +1,139 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Program: Radial Stitcher
+// Author: Felix Tsao
+// Contact: hello@felixtsao.com
+//
+// Summary:
+//
+//     Simple panorama image/video stitcher. Assumes input frames are taken
+//     from radially symmetric viewpoints i.e. after projection, stitching
+//     challenge is reduced to recovering angles between cameras
+//     i.e. translation in the video plane space.
+//
+//     Developed using OpenCV 3.1.0 release and Ubuntu 16.04
+//
+//     Written using feature descriptors from OpenCV. This code is free to be
+//     copied and modified and adheres to the same OpenCV license below.
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this
+//  license. If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//                For Open Source Computer Vision Library
+//
+// Copyright (C) 2000-2008, Intel Corporation, all rights reserved.
+// Copyright (C) 2009, Willow Garage Inc., all rights reserved.
+// Third party copyrights are property of their respective owners.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistribution's of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//   * Redistribution's in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * The name of the copyright holders may not be used to endorse or promote
+//     products derived from this software without specific prior written
+//     permission.
+//
+// This software is provided by the copyright holders and contributors "as is"
+// and any express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular purpose
+// are disclaimed. In no event shall the Intel Corporation or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or business
+// interruption) however caused and on any theory of liability, whether in
+// contract, strict liability, or tort (including negligence or otherwise)
+// arising in any way out of the use of this software, even if advised of the
+// possibility of such damage.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef VIDEO_STITCHER_HPP
+#define VIDEO_STITCHER_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameQueue.hpp"
+#include "RadialStitcher.hpp"
+#ifdef RADSTITCH_WITH_CUDA
+#include "GpuStitcher.hpp"
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Video Stitcher Class decodes synchronized camera streams, stitches them frame
+// by frame and encodes an equirectangular video the viewer can play directly.
+// Decode, stitch and encode run on their own threads connected by bounded
+// queues so the stages overlap without buffering the whole clip.
+// -----------------------------------------------------------------------------
+class VideoStitcher {
+
+    public:
+
+        VideoStitcher(int numInputs, char ** inputNames, const char * outputName,
+            const RadialStitcher::Settings& settings = RadialStitcher::Settings());
+        ~VideoStitcher();
+
+        // Runs the pipeline until any input runs out of frames
+        int Run();
+
+        // Registers numSets frame sets, one second apart, and saves the
+        // averaged transforms. Run then skips straight to warp and blend
+        int Calibrate(const std::string& fileName, int numSets);
+        int loadCalibration(const std::string& fileName);
+
+        // Warp and blend on a CUDA device, registration stays on the CPU
+        int setUseGpu(bool useGpu);
+
+        // Stitcher's profiler, also gets encode timing and frame latencies
+        Profiler& getProfiler() { return stitcher.getProfiler(); }
+
+    private:
+
+        // Pipeline Parameters
+        int numInputs;
+        double fps;
+        static const size_t queueDepth = 4; // Frames in flight between stages
+        bool useGpu;
+        int gpuFramesSinceGains; // GPU frames bypass the stitcher, gains are re-measured on its interval
+
+        std::vector<std::string> inputNames; // Video files or capture device ids
+        std::string outputName;
+
+        RadialStitcher stitcher;
+#ifdef RADSTITCH_WITH_CUDA
+        GpuStitcher gpu; // Set up from stitcher once the first frame set is registered
+#endif
+
+        // Pipeline stages and the queues between them
+        std::vector<cv::Ptr<cv::VideoCapture> > captures;
+        std::vector<cv::Ptr<FrameQueue<cv::Mat> > > decodeQueues; // One per camera
+        FrameQueue<cv::Mat> encodeQueue; // Finished panoramas
+        FrameQueue<cv::Mat> recycleQueue; // Encoded panoramas handed back for reuse
+
+        // Auxiliary functions
+        int openInputs();
+        void decode(int input);
+        void encode();
+        int stitchFrame(std::vector<cv::Mat>& frames, int index, cv::Mat& panorama);
+
+};
+
+#endif
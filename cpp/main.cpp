@@ -62,10 +62,20 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 // Standard
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
+// OpenCV 3.1.0
+#include <opencv2/opencv.hpp>
+
 // Radial Stitcher
+#include "BatchStitcher.hpp"
+#include "LiveStitcher.hpp"
 #include "RadialStitcher.hpp"
+#include "TiffStripWriter.hpp"
+#include "TilePyramidWriter.hpp"
+#include "VideoStitcher.hpp"
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -75,7 +85,50 @@
 int usage(){
     std::cout << std::endl;
     std::cout << "Usage:" << std::endl;
-    std::cout << "    ./radStitch <image1> <image2> ... <imageN>" << std::endl;
+    std::cout << "    ./radStitch [options] <image1> <image2> ... <imageN>" << std::endl;
+    std::cout << "    ./radStitch [options] --video <output.mp4> <video1> <video2> ... <videoN>" << std::endl;
+    std::cout << "    ./radStitch [options] --batch <manifest|directory>" << std::endl;
+    std::cout << "    ./radStitch --calib <calib.yml> [options] --live <width> <stream1> ... <streamN>" << std::endl;
+    std::cout << std::endl;
+    std::cout << "    Videos may also be capture device numbers e.g. 0 1 2" << std::endl;
+    std::cout << "    Streams may be URLs, device numbers or SJ4000 hosts e.g. 192.168.1.254" << std::endl;
+    std::cout << "    Manifest lines are a set directory, or an output name then its images" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "    --batch-out <dir>        Where batch panoramas are written (default batch)" << std::endl;
+    std::cout << "    --calibrate <calib.yml>  Register inputs and save transforms for later runs" << std::endl;
+    std::cout << "    --calib <calib.yml>      Skip feature matching, use saved transforms" << std::endl;
+    std::cout << "    --frames <K>             Frame sets averaged when calibrating from video (default 5)" << std::endl;
+    std::cout << "    --focal <pixels>         Prewarp focal length (default 2800)" << std::endl;
+    std::cout << "    --projection <type>      spherical (default) or cylindrical" << std::endl;
+    std::cout << "    --bands <rows>           Stream the panorama to panorama.tif in bands, for images too big to hold" << std::endl;
+    std::cout << "    --tiles <dir>            Write a JPEG tile pyramid and manifest for the viewer instead" << std::endl;
+    std::cout << "    --tile-size <pixels>     Tile pyramid tile width and height, even (default 512)" << std::endl;
+    std::cout << "    --interpolation <type>   Prewarp sampling, nearest (default) or bilinear" << std::endl;
+    std::cout << "    --preview <N>            Decode stills at 1/N size, 2, 4 or 8, for quick previews" << std::endl;
+    std::cout << "    --width <pixels>         Output panorama width, resampled during the prewarp (default native)" << std::endl;
+    std::cout << "    --loop <type>            open (default) or closed, full 360 with the last image matched to the first" << std::endl;
+    std::cout << "    --overlap <fraction>     Only detect features in overlap strips this wide e.g. 0.3" << std::endl;
+    std::cout << "    --match-scale <N>        Detect and match on 1/N size images, refined at full size e.g. 4" << std::endl;
+    std::cout << "    --matcher <type>         bf (Hamming brute force, default) or lsh (FLANN LSH index)" << std::endl;
+    std::cout << "    --filter <type>          ratio (ratio test, default) or crosscheck" << std::endl;
+    std::cout << "    --match-time <ms>        Cap on total matching time per frame set" << std::endl;
+    std::cout << "    --estimator <type>       histogram (linear time voting, default) or ransac" << std::endl;
+    std::cout << "    --blend <type>           feather (fixed-point SIMD, default), multiband, seam or reference" << std::endl;
+    std::cout << "    --blend-levels <N>       Multi-band pyramid levels (default 5)" << std::endl;
+    std::cout << "    --blend-band <rows>      Multi-band working band height, bounds memory (default 256)" << std::endl;
+    std::cout << "    --seam-band <pixels>     Seam mode feather half-width (default 16)" << std::endl;
+    std::cout << "    --seam-window <pixels>   Video seam movement per frame, 0 recuts every frame (default 24)" << std::endl;
+    std::cout << "    --exposure <type>        none (default), gain (one per camera) or color (one per channel)" << std::endl;
+    std::cout << "    --gain-interval <N>      Video frame sets between gain updates (default 15)" << std::endl;
+    std::cout << "    --gain-smoothing <w>     Weight of each video gain update, 1 for none (default 0.2)" << std::endl;
+    std::cout << "    --incremental <N>        Video recomposes only changed cells, everything every N frame sets" << std::endl;
+    std::cout << "    --change-threshold <l>   Mean difference in levels that marks a block changed (default 4)" << std::endl;
+    std::cout << "    --stereo <offset>        Top-bottom stereo, eye strips this fraction of the width off center e.g. 0.1" << std::endl;
+    std::cout << "    --mask-bits <bits>       Alpha mask storage, 8, 16 (default) or 64 (double)" << std::endl;
+    std::cout << "    --profile <file.jsonl>   Write stage timings and counters as JSON lines" << std::endl;
+    std::cout << "    --threads <N>            Cap on worker threads (default all cores)" << std::endl;
+    std::cout << "    --backend <type>         Video warp and blend on cpu (default) or cuda" << std::endl;
     std::cout << std::endl;
     std::cout << "Constraints:" << std::endl;
     std::cout << "    1) Stitcher assumes inputs are taken from radially symmetric viewpoints relative to a single optical center" << std::endl;
@@ -89,17 +142,282 @@ int usage(){
 // -----------------------------------------------------------------------------
 int main(int argc, char ** argv) {
 
-    if(argc < 3) usage(); // Need at least 2 images
-    int numImages = argc - 1;
+    const char * videoOut = 0; // Video mode output
+    const char * batchIn = 0; // Batch mode manifest or directory
+    int liveWidth = 0; // Live preview width, 0 when not previewing
+    const char * batchOut = "batch";
+    const char * calibOut = 0; // Calibration to write
+    const char * calibIn = 0; // Calibration to use
+    const char * profileOut = 0; // JSON lines timing log
+    int calibFrames = 5;
+    bool useGpu = false;
+    int bandRows = 0; // Stills only, 0 composes the whole canvas
+    const char * tilesOut = 0; // Tile pyramid directory
+    int tileSize = 512;
+    RadialStitcher::Settings settings;
+
+    // Options come before inputs
+    int arg = 1;
+    while (arg < argc && !strncmp(argv[arg], "--", 2)) {
+        if(arg + 1 >= argc) usage(); // Every option takes a value
+        if(!strcmp(argv[arg], "--video")) videoOut = argv[arg + 1];
+        else if(!strcmp(argv[arg], "--batch")) batchIn = argv[arg + 1];
+        else if(!strcmp(argv[arg], "--batch-out")) batchOut = argv[arg + 1];
+        else if(!strcmp(argv[arg], "--live")){
+            liveWidth = atoi(argv[arg + 1]);
+            if(liveWidth < 1) usage();
+        }
+        else if(!strcmp(argv[arg], "--calibrate")) calibOut = argv[arg + 1];
+        else if(!strcmp(argv[arg], "--calib")) calibIn = argv[arg + 1];
+        else if(!strcmp(argv[arg], "--profile")) profileOut = argv[arg + 1];
+        else if(!strcmp(argv[arg], "--frames")) calibFrames = atoi(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--focal")) settings.focalLength = atof(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--projection")){
+            if(!strcmp(argv[arg + 1], "spherical")) settings.projection = RadialStitcher::SPHERICAL;
+            else if(!strcmp(argv[arg + 1], "cylindrical")) settings.projection = RadialStitcher::CYLINDRICAL;
+            else usage();
+        }
+        else if(!strcmp(argv[arg], "--width")) settings.outputWidth = atoi(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--preview")){
+            settings.decodeScale = atoi(argv[arg + 1]);
+            if(settings.decodeScale != 1 && settings.decodeScale != 2 &&
+                settings.decodeScale != 4 && settings.decodeScale != 8) usage();
+        }
+        else if(!strcmp(argv[arg], "--interpolation")){
+            if(!strcmp(argv[arg + 1], "nearest")) settings.bilinear = false;
+            else if(!strcmp(argv[arg + 1], "bilinear")) settings.bilinear = true;
+            else usage();
+        }
+        else if(!strcmp(argv[arg], "--bands")){
+            bandRows = atoi(argv[arg + 1]);
+            if(bandRows < 1) usage();
+        }
+        else if(!strcmp(argv[arg], "--tiles")) tilesOut = argv[arg + 1];
+        else if(!strcmp(argv[arg], "--tile-size")){
+            tileSize = atoi(argv[arg + 1]);
+            if(tileSize < 2 || tileSize % 2) usage();
+        }
+        else if(!strcmp(argv[arg], "--loop")){
+            if(!strcmp(argv[arg + 1], "open")) settings.closeLoop = false;
+            else if(!strcmp(argv[arg + 1], "closed")) settings.closeLoop = true;
+            else usage();
+        }
+        else if(!strcmp(argv[arg], "--matcher")){
+            if(!strcmp(argv[arg + 1], "bf")) settings.matcher = RadialStitcher::BRUTE_FORCE;
+            else if(!strcmp(argv[arg + 1], "lsh")) settings.matcher = RadialStitcher::LSH;
+            else usage();
+        }
+        else if(!strcmp(argv[arg], "--filter")){
+            if(!strcmp(argv[arg + 1], "ratio")) settings.matchFilter = RadialStitcher::RATIO_TEST;
+            else if(!strcmp(argv[arg + 1], "crosscheck")) settings.matchFilter = RadialStitcher::CROSS_CHECK;
+            else usage();
+        }
+        else if(!strcmp(argv[arg], "--estimator")){
+            if(!strcmp(argv[arg + 1], "histogram")) settings.estimator = RadialStitcher::HISTOGRAM;
+            else if(!strcmp(argv[arg + 1], "ransac")) settings.estimator = RadialStitcher::RANSAC;
+            else usage();
+        }
+        else if(!strcmp(argv[arg], "--blend")){
+            if(!strcmp(argv[arg + 1], "feather")) settings.blendMode = RadialStitcher::FEATHER;
+            else if(!strcmp(argv[arg + 1], "reference")) settings.blendMode = RadialStitcher::FEATHER_REFERENCE;
+            else if(!strcmp(argv[arg + 1], "multiband")) settings.blendMode = RadialStitcher::MULTIBAND;
+            else if(!strcmp(argv[arg + 1], "seam")) settings.blendMode = RadialStitcher::SEAM;
+            else usage();
+        }
+        else if(!strcmp(argv[arg], "--blend-levels")) settings.blendLevels = atoi(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--blend-band")) settings.blendBandRows = atoi(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--seam-band")) settings.seamBand = atoi(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--seam-window")) settings.seamWindow = atoi(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--exposure")){
+            if(!strcmp(argv[arg + 1], "none")) settings.exposure = RadialStitcher::EXPOSURE_NONE;
+            else if(!strcmp(argv[arg + 1], "gain")) settings.exposure = RadialStitcher::EXPOSURE_GAIN;
+            else if(!strcmp(argv[arg + 1], "color")) settings.exposure = RadialStitcher::EXPOSURE_CHANNELS;
+            else usage();
+        }
+        else if(!strcmp(argv[arg], "--gain-interval")) settings.gainInterval = atoi(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--gain-smoothing")) settings.gainSmoothing = atof(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--incremental")){
+            settings.refreshInterval = atoi(argv[arg + 1]);
+            if(settings.refreshInterval < 1) usage();
+        }
+        else if(!strcmp(argv[arg], "--change-threshold")) settings.changeThreshold = atof(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--stereo")){
+            settings.stereo = true;
+            settings.stereoOffset = atof(argv[arg + 1]);
+            if(settings.stereoOffset <= 0 || settings.stereoOffset >= 0.5) usage();
+        }
+        else if(!strcmp(argv[arg], "--mask-bits")){
+            int bits = atoi(argv[arg + 1]);
+            if(bits == 8) settings.maskDepth = CV_8U;
+            else if(bits == 16) settings.maskDepth = CV_16U;
+            else if(bits == 64) settings.maskDepth = CV_64F;
+            else usage();
+        }
+        else if(!strcmp(argv[arg], "--backend")){
+            if(!strcmp(argv[arg + 1], "cpu")) useGpu = false;
+            else if(!strcmp(argv[arg + 1], "cuda")) useGpu = true;
+            else usage();
+        }
+        else if(!strcmp(argv[arg], "--threads")) settings.numThreads = atoi(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--match-time")) settings.maxMatchTime = atof(argv[arg + 1]);
+        else if(!strcmp(argv[arg], "--match-scale")){
+            settings.matchScale = atoi(argv[arg + 1]);
+            if(settings.matchScale < 1) usage();
+        }
+        else if(!strcmp(argv[arg], "--overlap")){
+            settings.overlapOnly = true;
+            settings.overlapFraction = atof(argv[arg + 1]);
+        }
+        else usage();
+        arg += 2;
+    }
+
+    int numInputs = argc - arg;
+    char ** inputs = argv + arg;
+
+    if(settings.numThreads > 0) cv::setNumThreads(settings.numThreads); // Once, process wide
+
+    int status = 0;
+
+    // Batch mode, every set in the manifest to its own panorama
+    if(batchIn){
+
+        if(numInputs > 0 || videoOut || calibOut) usage(); // Sets come from the manifest
+
+        BatchStitcher * bs = new BatchStitcher(batchIn, batchOut, settings);
+
+        if(calibIn) status = bs->setCalibration(calibIn);
+        if(!status) status = bs->Run();
+        if(status) std::cout << "Batch failed." << std::endl;
+
+        delete bs;
+
+        return status;
+
+    }
+
+    if(numInputs < 2) usage(); // Need at least 2 images
+
+    // Live mode, preview network streams through a calibration
+    if(liveWidth){
+
+        if(!calibIn || videoOut || calibOut) usage();
+        settings.outputWidth = liveWidth;
+
+        LiveStitcher * ls = new LiveStitcher(numInputs, inputs, settings);
+
+        if(profileOut) status = ls->getProfiler().open(profileOut);
+        if(!status) status = ls->loadCalibration(calibIn);
+        if(!status) status = ls->Run([](const cv::Mat& panorama){
+            cv::imshow("preview", panorama);
+            return cv::waitKey(1) != 27; // Esc
+        });
+        if(status) std::cout << "Preview failed." << std::endl;
+
+        delete ls;
+
+        return status;
+
+    }
+
+    // Video mode, stitch synchronized streams into an equirectangular video
+    if(videoOut){
+
+        VideoStitcher * vs = new VideoStitcher(numInputs, inputs, videoOut, settings);
 
-    // Load in images to stitcher
-    RadialStitcher * rs = new RadialStitcher(numImages, argv);
+        status = vs->setUseGpu(useGpu);
+        if(!status && profileOut) status = vs->getProfiler().open(profileOut);
+        if(!status && calibIn) status = vs->loadCalibration(calibIn);
+        else if(!status && calibOut) status = vs->Calibrate(calibOut, calibFrames);
+
+        if(!status) status = vs->Run();
+        if(status) std::cout << "Stitch failed." << std::endl;
+
+        delete vs;
+
+        return status;
+
+    }
+
+    if(useGpu) std::cout << "CUDA backend applies to video, stitching on the CPU." << std::endl;
+
+    // Banded composes can't hold a stereo canvas and feather in place of seams
+    if(tilesOut || bandRows > 0){
+        if(settings.stereo){
+            std::cout << "Stereo panoramas are composed whole, not in bands." << std::endl;
+            return 1;
+        }
+        if(settings.blendMode == RadialStitcher::SEAM)
+            std::cout << "Seam blending needs whole overlaps, feathering bands instead." << std::endl;
+    }
+
+    // Load in images to stitcher, calibration first since it sets the prewarp
+    RadialStitcher * rs = new RadialStitcher(numInputs, settings);
+
+    if(profileOut) status = rs->getProfiler().open(profileOut);
+    if(!status && calibIn) status = rs->loadCalibration(calibIn);
+    if(!status) status = rs->readImages(inputs);
+    if(!status && calibOut){
+        status = rs->calibrate();
+        if(!status) status = rs->saveCalibration(calibOut);
+    }
+
+    // Tiles are cut from the bands as they are composed, a row of tiles at a time
+    if(!status && tilesOut){
+
+        int rows = bandRows > 0 ? bandRows : tileSize;
+        std::cout << "Stitching " << numInputs << " images in bands of " << rows << " rows..." << std::endl;
+
+        TilePyramidWriter tiles;
+        status = rs->Stitch([&](const cv::Mat& band, int y){
+            if(y == 0 && tiles.open(tilesOut, rs->getCanvasSize(), tileSize)) return -1;
+            return tiles.writeBand(band);
+        }, rows);
+
+        if(!status) status = tiles.close();
+        if(status) std::cout << "Stitch failed." << std::endl;
+
+        delete rs;
+
+        return status;
+
+    }
+
+    // Large panoramas go to disk band by band and are never shown
+    if(!status && bandRows > 0){
+
+        std::cout << "Stitching " << numInputs << " images in bands of " << bandRows << " rows..." << std::endl;
+
+        TiffStripWriter tiff;
+        status = rs->Stitch([&](const cv::Mat& band, int y){
+            if(y == 0 && tiff.open("panorama.tif", rs->getCanvasSize(), band.rows)) return -1;
+            return tiff.writeStrip(band);
+        }, bandRows);
+
+        if(!status) status = tiff.close();
+        if(status) std::cout << "Stitch failed." << std::endl;
+
+        delete rs;
+
+        return status;
+
+    }
 
     // Try stitching images
-    if(rs->Stitch()) std::cout << "Stitch failed." << std::endl;;
+    cv::Mat panorama;
+    if(!status) std::cout << "Stitching " << numInputs << " images..." << std::endl;
+    if(!status) status = rs->Stitch(panorama);
+
+    if(!status){
+        cv::imwrite("panorama.jpg", panorama);
+        cv::imshow("panorama", panorama);
+        cv::waitKey(0);
+    } else {
+        std::cout << "Stitch failed." << std::endl;
+    }
 
     delete rs;
 
-    return 0;
+    return status;
 
 }
@@ -22,7 +22,11 @@ var scene,
     video,
     vr,
     pseudo3d,
-    mobile;
+    mobile,
+    tiles = [],
+    tile_loader,
+    frustum = new THREE.Frustum(),
+    view_projection = new THREE.Matrix4();
 
 // Choose video source here
 var video_path = 'video/src.mp4';
@@ -30,12 +34,19 @@ var video_path = 'video/src.mp4';
 // Choose image source here
 var image_path = 'img/src.jpg';
 
+// Or a tile pyramid written by radStitch --tiles, used instead of image_path
+// e.g. 'img/tiles', photo mode only
+var tiles_path = '';
+
 // Choose a projection from those available in the switch
 var projection = 'equirectangular';
 
 // Set media type: video or photo
 var play_video = true;
 
+// Source is top-bottom stereo, left eye on top (radStitch --stereo)
+var stereo = false;
+
 // LAUNCH WEB APP //
 ////////////////////
 main();           //
@@ -135,6 +146,8 @@ function main(){
 
     if(play_video){
         init_video_screen();
+    } else if(tiles_path){
+        init_tile_screen();
     } else {
         init_photo_screen();
     }
@@ -171,6 +184,7 @@ function update(dt) {
 	resize();
 	camera.updateProjectionMatrix();
 	controls.update(dt);
+	update_tiles();
 }
 
 
@@ -203,9 +217,84 @@ function init_camera(vr){
 function init_photo_screen(){
     texture = {map: new THREE.TextureLoader().load(image_path)}
 	material = new THREE.MeshBasicMaterial(texture);
-	var screen = new THREE.Mesh(geometry, material);
-	screen.position.set(0,0,0);
-	scene.add(screen);
+	add_screen(material);
+}
+
+
+// Coarsest tile covers the whole sphere right away, then the tiles of the
+// level that matches the screen are fetched as they come into view
+function init_tile_screen(){
+    tile_loader = new THREE.TextureLoader();
+    $.getJSON(tiles_path + '/manifest.json', function(manifest){
+        var base = new THREE.Mesh(geometry, new THREE.MeshBasicMaterial({map: load_tile(tile_url(0, 0, 0))}));
+        scene.add(base);
+
+        var z = tile_level(manifest);
+        var level = manifest.levels[z];
+        var size = manifest.tileSize;
+        if(z == 0) return; // Base tile is already sharp enough
+
+        for(var row = 0; row < level.rows; row++){
+            for(var column = 0; column < level.columns; column++){
+                var w = Math.min(size, level.width - column * size);
+                var h = Math.min(size, level.height - row * size);
+                var patch = new THREE.SphereGeometry(250, // In front of the base
+                    Math.max(2, Math.ceil(64 * w / level.width)), Math.max(2, Math.ceil(32 * h / level.height)),
+                    2 * Math.PI * column * size / level.width, 2 * Math.PI * w / level.width,
+                    Math.PI * row * size / level.height, Math.PI * h / level.height);
+                patch.scale(-1, 1, 1); // Same flip as the base sphere
+
+                var tile = new THREE.Mesh(patch, new THREE.MeshBasicMaterial());
+                tile.visible = false; // Until its texture arrives
+                tile.userData = {url: tile_url(z, row, column), requested: false};
+                tiles.push(tile);
+                scene.add(tile);
+            }
+        }
+    });
+}
+
+
+// Coarsest level with at least a screen pixel per texel, else the finest
+function tile_level(manifest){
+    var vfov = camera.fov * Math.PI / 180;
+    var hfov = 2 * Math.atan(Math.tan(vfov / 2) * camera.aspect);
+    var needed = 2 * Math.PI * window.innerWidth * (window.devicePixelRatio || 1) / hfov;
+    for(var z = 0; z < manifest.levels.length; z++){
+        if(manifest.levels[z].width >= needed) return z;
+    }
+    return manifest.levels.length - 1;
+}
+
+
+function tile_url(z, row, column){
+    return tiles_path + '/' + z + '/' + row + '_' + column + '.jpg';
+}
+
+
+function load_tile(url, done){
+    return tile_loader.load(url, function(texture){
+        texture.minFilter = THREE.LinearFilter; // Edge tiles are not powers of two
+        texture.generateMipmaps = false;
+        if(done) done(texture);
+    });
+}
+
+
+// Requests tiles once they enter the view, each only once
+function update_tiles(){
+    if(!tiles.length) return;
+    view_projection.multiplyMatrices(camera.projectionMatrix, camera.matrixWorldInverse);
+    frustum.setFromMatrix(view_projection);
+    tiles.forEach(function(tile){
+        if(tile.userData.requested || !frustum.intersectsObject(tile)) return;
+        tile.userData.requested = true;
+        load_tile(tile.userData.url, function(texture){
+            tile.material.map = texture;
+            tile.material.needsUpdate = true;
+            tile.visible = true;
+        });
+    });
 }
 
 
@@ -223,9 +312,36 @@ function init_video_screen(){
         texture.generateMipmaps = false;
 
         var material = new THREE.MeshBasicMaterial({map: texture});
+        add_screen(material);
+}
+
+
+// One sphere, or one per eye showing its half of a top-bottom source. The
+// stereo cameras render layer 1 for the left eye and 2 for the right, the
+// main camera shows the left eye outside VR mode
+function add_screen(material){
+    if(!stereo){
         var screen = new THREE.Mesh(geometry, material);
         screen.position.set(0,0,0);
         scene.add(screen);
+        return;
+    }
+
+    camera.layers.enable(1);
+    for(var eye = 0; eye < 2; eye++){
+        var half = geometry.clone();
+        half.faceVertexUvs[0].forEach(function(face){
+            face.forEach(function(uv){
+                uv.y = uv.y / 2 + (eye == 0 ? 0.5 : 0); // Texture v runs bottom up
+            });
+        });
+        half.uvsNeedUpdate = true;
+
+        var screen = new THREE.Mesh(half, material);
+        screen.position.set(0,0,0);
+        screen.layers.set(eye + 1);
+        scene.add(screen);
+    }
 }
 
 function start_video(){